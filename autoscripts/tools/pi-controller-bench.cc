@@ -0,0 +1,141 @@
+/*
+ * This program measures the cost of the PI control law and drop decision
+ * (pi-controller.h) on their own, without ns-3.
+ *
+ * Build and run from the autoscripts directory:
+ *   make controller-bench
+ * or by hand:
+ *   g++ -O2 -std=c++17 -I../src/traffic-control/model -o tools/pi-controller-bench tools/pi-controller-bench.cc
+ *   ./tools/pi-controller-bench --n=10000000 --p=0.01
+*/
+
+#include "pi-controller.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace ns3;
+using namespace std;
+
+// Быстрый генератор равномерных чисел в [0, 1) (xorshift64*),
+// чтобы в замер не попадала стоимость генератора ns-3
+struct Uniform
+{
+	uint64_t state;
+
+	double operator() ()
+	{
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return ((state * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+	}
+};
+
+// Результат не используется, но записывается сюда, чтобы компилятор не
+// выбросил измеряемый код
+volatile double sink;
+
+// Миллионы операций в секунду за время от start до now
+template <typename Clock>
+double Rate (typename Clock::time_point start, uint64_t n)
+{
+	double s = chrono::duration<double> (Clock::now () - start).count ();
+	return n / s / 1e6;
+}
+
+template <PiUnit Unit, typename Real>
+void Run (const char *name, uint64_t n, double p, uint32_t pktSize)
+{
+	typedef chrono::steady_clock Clock;
+	PiController<Unit, Real> ctl;
+	ctl.SetQueueRef (50);
+	ctl.SetMeanPktSize (pktSize);
+	ctl.SetGains (0.00001822, 0.00001816);
+	ctl.Reset ();
+
+	// Длина очереди колеблется вокруг желаемой, как в установившемся режиме
+	uint32_t scale = (Unit == PiUnit::BYTES) ? pktSize : 1;
+	vector<uint32_t> qlen (1024);
+	for (uint32_t i = 0; i < qlen.size (); i++) {
+		qlen[i] = (40 + (i * 7) % 21) * scale;
+	}
+
+	auto start = Clock::now ();
+	for (uint64_t i = 0; i < n; i++) {
+		ctl.Update (ctl.GetLengthError (qlen[i & 1023]), 1);
+	}
+	double updates = Rate<Clock> (start, n);
+	sink = ctl.GetDropProbability ();
+
+	// Вероятность p задаётся одним шагом с A = p, B = 0 и ошибкой 1
+	ctl.Reset ();
+	ctl.SetGains (p, 0);
+	ctl.Update (1, 1);
+
+	// Размеры пакетов в режиме байтов разные, со средним pktSize
+	vector<uint32_t> sizes (1024);
+	for (uint32_t i = 0; i < sizes.size (); i++) {
+		sizes[i] = (i % 3 == 0) ? pktSize / 2 : pktSize * 5 / 4;
+	}
+
+	Uniform uniform = {88172645463325252ULL};
+	uint64_t drops = 0;
+	start = Clock::now ();
+	for (uint64_t i = 0; i < n; i++) {
+		drops += ctl.DropEarly (sizes[i & 1023], uniform);
+	}
+	double decisions = Rate<Clock> (start, n);
+
+	uint64_t geoDrops = 0;
+	ctl.DrawSkipCount (uniform);
+	start = Clock::now ();
+	for (uint64_t i = 0; i < n; i++) {
+		if (!ctl.SkipEarly (sizes[i & 1023])) {
+			ctl.DrawSkipCount (uniform);
+			geoDrops++;
+		}
+	}
+	double geometric = Rate<Clock> (start, n);
+	sink = drops + geoDrops;
+
+	printf ("%-16s %12.1f %12.1f %12.1f %10.5f %10.5f\n", name, updates, decisions, geometric,
+	        (double) drops / n, (double) geoDrops / n);
+}
+
+int main (int argc, char *argv[])
+{
+	// Количество операций в каждом замере
+	uint64_t n = 10000000;
+	// Вероятность сброса при замере решений
+	double p = 0.01;
+	// Средний размер пакета в байтах
+	uint32_t pktSize = 1000;
+
+	for (int i = 1; i < argc; i++) {
+		if (strncmp (argv[i], "--n=", 4) == 0) {
+			n = strtoull (argv[i] + 4, 0, 10);
+		} else if (strncmp (argv[i], "--p=", 4) == 0) {
+			p = strtod (argv[i] + 4, 0);
+		} else if (strncmp (argv[i], "--pktSize=", 10) == 0) {
+			pktSize = strtoul (argv[i] + 10, 0, 10);
+		} else {
+			fprintf (stderr, "usage: %s [--n=operations] [--p=drop probability] [--pktSize=bytes]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (n == 0 || pktSize == 0) {
+		fprintf (stderr, "--n and --pktSize must be positive\n");
+		return 1;
+	}
+
+	printf ("%-16s %12s %12s %12s %10s %10s\n", "mode", "Mupdates/s", "Mdecisions/s", "Mgeometric/s",
+	        "drop rate", "geo rate");
+	Run<PiUnit::PACKETS, double> ("packets/double", n, p, pktSize);
+	Run<PiUnit::BYTES, double> ("bytes/double", n, p, pktSize);
+	Run<PiUnit::PACKETS, float> ("packets/float", n, p, pktSize);
+	Run<PiUnit::BYTES, float> ("bytes/float", n, p, pktSize);
+	return 0;
+}
@@ -0,0 +1,263 @@
+/*
+ * Fluid model of N TCP flows through a PI bottleneck: the equations of
+ * Misra, Gong and Towsley (SIGCOMM 2000) with the PI law of PiQueueDisc
+ * (pi-controller.h), sampled at W times per second as CalculateP is.
+ *
+ *   dW/dt = 1 / R - W (t) W (t - R) / (2 R (t - R)) p (t - R)
+ *   dq/dt = N W / R - C,   R = q / C + Tp
+ *
+ * Units are packets of the mean size and seconds. The defaults are the
+ * topology of first-bulksend.cc.
+ *
+ * One configuration writes the queue trajectory in the .plotme format of
+ * the traffic scripts (time, queue, mean queue every 0.1 s):
+ *   ./tools/pi-fluid --out=./pi/raw/pi-queue1-Fluid.plotme
+ *   gnuplot -c ./pi/pi-queue1 Fluid
+ *
+ * Comma-separated lists sweep every combination and print one summary
+ * line per configuration:
+ *   ./tools/pi-fluid --qRef=30,50,70 --a=0.00001822,0.00003644 --n=5,20,50
+*/
+
+#include "pi-controller.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+using namespace std;
+
+// Параметры одной конфигурации
+struct Config
+{
+	double n;           // количество потоков TCP
+	double capacity;    // пропускная способность, пакетов/с
+	double tp;          // время распространения туда и обратно, с
+	double qRef;        // желаемая длина очереди, пакетов
+	double limit;       // предел очереди, пакетов
+	double a;           // параметр A
+	double b;           // параметр B
+	double w;           // частота пересчёта вероятности, раз в секунду
+};
+
+// Итог одной конфигурации
+struct Summary
+{
+	double mean;        // средняя длина очереди во второй половине
+	double stddev;      // её стандартное отклонение
+	double max;         // наибольшая длина очереди
+	double settling;    // время, после которого очередь остаётся в пределах 10% от qRef
+	double p;           // вероятность сброса в конце
+};
+
+// Решение уравнений методом Эйлера. Шаг - период пересчёта, делённый на
+// substeps, так что пересчёт вероятности всегда попадает на шаг.
+// Если plot не пустой, туда каждые 0.1 с пишется длина очереди
+Summary Solve (const Config &c, double duration, uint32_t substeps, FILE *plot)
+{
+	PiController<PiUnit::PACKETS, double> ctl;
+	ctl.SetQueueRef (c.qRef);
+	ctl.SetGains (c.a, c.b);
+	ctl.Reset ();
+
+	double dt = 1.0 / c.w / substeps;
+	uint64_t steps = duration / dt;
+
+	// История за наибольшую возможную задержку, по кругу. Вместо R хранится
+	// p / (2 R): в уравнении для W они встречаются только так
+	struct State { double win, pOver2r; };
+	double invDt = 1 / dt;
+	double invC = 1 / c.capacity;
+	size_t histSize = (size_t) ((c.tp + c.limit * invC) * invDt) + 2;
+	vector<State> hist (histSize, State {1, 0});
+	size_t pos = 0;
+
+	double win = 1;
+	double q = 0;
+	double p = 0;
+
+	uint64_t plotEvery = (uint64_t) llround (0.1 / dt);
+	plotEvery = plotEvery < 1 ? 1 : plotEvery;
+	uint64_t toPlot = 0;
+	double plotSum = 0;
+	uint64_t plotCount = 0;
+	uint32_t toUpdate = substeps;
+
+	uint64_t half = steps / 2;
+	double sum = 0, sumSq = 0, max = 0, settling = 0;
+	double band = 0.1 * c.qRef;
+
+	for (uint64_t i = 0; i < steps; i++) {
+		double r = q * invC + c.tp;
+		double invR = 1 / r;
+		hist[pos] = State {win, p * 0.5 * invR};
+
+		if (plot && toPlot-- == 0) {
+			toPlot = plotEvery - 1;
+			plotSum += q;
+			plotCount++;
+			fprintf (plot, "%g %g %g\n", i * dt, q, plotSum / plotCount);
+		}
+
+		// Значения на время R назад; до начала истории - начальные
+		size_t d = (size_t) (r * invDt);
+		d = d < 1 ? 1 : (d >= histSize ? histSize - 1 : d);
+		State past = {1, 0};
+		if (i >= d) {
+			past = hist[pos >= d ? pos - d : pos + histSize - d];
+		}
+		pos = (pos + 1 == histSize) ? 0 : pos + 1;
+
+		double dW = invR - win * past.win * past.pOver2r;
+		double dq = c.n * win * invR - c.capacity;
+		win += dW * dt;
+		win = win < 1 ? 1 : win;
+		q += dq * dt;
+		q = q < 0 ? 0 : (q > c.limit ? c.limit : q);
+
+		// Пересчёт вероятности по целой длине очереди, как в CalculateP
+		if (--toUpdate == 0) {
+			toUpdate = substeps;
+			ctl.Update (ctl.GetLengthError ((uint64_t) (q + 0.5)), 1);
+			p = ctl.GetDropProbability ();
+		}
+
+		if (fabs (q - c.qRef) > band) {
+			settling = (i + 1) * dt;
+		}
+		max = q > max ? q : max;
+		if (i >= half) {
+			sum += q;
+			sumSq += q * q;
+		}
+	}
+
+	uint64_t count = steps - half;
+	Summary s;
+	s.mean = count ? sum / count : 0;
+	s.stddev = count ? sqrt (fmax (0, sumSq / count - s.mean * s.mean)) : 0;
+	s.max = max;
+	s.settling = settling;
+	s.p = p;
+	return s;
+}
+
+// Разбор списка чисел через запятую
+bool ParseList (const char *text, vector<double> &values)
+{
+	values.clear ();
+	while (*text) {
+		char *end;
+		double v = strtod (text, &end);
+		if (end == text) {
+			return false;
+		}
+		values.push_back (v);
+		text = (*end == ',') ? end + 1 : end;
+		if (*end != ',' && *end != 0) {
+			return false;
+		}
+	}
+	return !values.empty ();
+}
+
+int main (int argc, char *argv[])
+{
+	// Значения по умолчанию - топология first-bulksend.cc:
+	// 5 потоков, 10 Мбит/с при пакетах по 1000 байт, RTT 2 * (5 + 50 + 5) мс
+	vector<double> n = {5};
+	vector<double> capacity = {1250};
+	vector<double> tp = {0.12};
+	vector<double> qRef = {50};
+	vector<double> limit = {200};
+	vector<double> a = {0.00001822};
+	vector<double> b = {0.00001816};
+	vector<double> w = {170};
+	// Длительность моделирования в секундах
+	double duration = 100;
+	// Количество шагов интегрирования на один период пересчёта
+	uint32_t substeps = 4;
+	// Файл для траектории очереди (только для одной конфигурации)
+	string out;
+
+	struct Option { const char *name; vector<double> *values; };
+	Option options[] = {
+		{"n", &n}, {"capacity", &capacity}, {"tp", &tp}, {"qRef", &qRef},
+		{"limit", &limit}, {"a", &a}, {"b", &b}, {"w", &w}};
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *eq = strchr (arg, '=');
+		bool ok = strncmp (arg, "--", 2) == 0 && eq;
+		string name = ok ? string (arg + 2, eq) : "";
+		if (ok && name == "duration") {
+			duration = strtod (eq + 1, 0);
+		} else if (ok && name == "substeps") {
+			substeps = strtoul (eq + 1, 0, 10);
+		} else if (ok && name == "out") {
+			out = eq + 1;
+		} else if (ok) {
+			ok = false;
+			for (Option &o : options) {
+				if (name == o.name) {
+					ok = ParseList (eq + 1, *o.values);
+				}
+			}
+		}
+		if (!ok) {
+			fprintf (stderr, "usage: %s [--n=] [--capacity=pkt/s] [--tp=s] [--qRef=] [--limit=] [--a=] [--b=] [--w=]"
+			         " [--duration=s] [--substeps=] [--out=file.plotme]\n"
+			         "lists such as --n=5,20,50 sweep every combination\n", argv[0]);
+			return 1;
+		}
+	}
+	if (duration <= 0 || substeps == 0) {
+		fprintf (stderr, "--duration and --substeps must be positive\n");
+		return 1;
+	}
+
+	// Все сочетания значений
+	vector<Config> configs;
+	for (double vn : n) for (double vc : capacity) for (double vt : tp) for (double vq : qRef)
+	for (double vl : limit) for (double va : a) for (double vb : b) for (double vw : w) {
+		if (vc <= 0 || vt <= 0 || vw <= 0 || vl <= 0) {
+			fprintf (stderr, "capacity, tp, limit and w must be positive\n");
+			return 1;
+		}
+		configs.push_back ({vn, vc, vt, vq, vl, va, vb, vw});
+	}
+
+	FILE *plot = 0;
+	if (!out.empty ()) {
+		if (configs.size () != 1) {
+			fprintf (stderr, "--out needs a single configuration\n");
+			return 1;
+		}
+		plot = fopen (out.c_str (), "w");
+		if (!plot) {
+			perror (out.c_str ());
+			return 1;
+		}
+	}
+
+	printf ("# %8s %10s %8s %8s %8s %12s %12s %8s %10s %10s %10s %10s %10s\n", "n", "capacity", "tp", "qRef",
+	        "limit", "a", "b", "w", "mean", "stddev", "max", "settling", "p");
+	auto start = chrono::steady_clock::now ();
+	for (const Config &c : configs) {
+		Summary s = Solve (c, duration, substeps, plot);
+		printf ("%10g %10g %8g %8g %8g %12g %12g %8g %10.3f %10.3f %10.3f %10.3f %10.6f\n", c.n, c.capacity, c.tp,
+		        c.qRef, c.limit, c.a, c.b, c.w, s.mean, s.stddev, s.max, s.settling, s.p);
+	}
+	double elapsed = chrono::duration<double> (chrono::steady_clock::now () - start).count ();
+	fprintf (stderr, "%zu configurations in %.3f s (%.0f per second)\n", configs.size (), elapsed,
+	         configs.size () / elapsed);
+
+	if (plot) {
+		fclose (plot);
+	}
+	return 0;
+}
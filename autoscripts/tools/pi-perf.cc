@@ -0,0 +1,403 @@
+/*
+ * Performance regression suite of the traffic scripts.
+ *
+ * Every line of the suite file (--suite) is a scenario: a name, a script
+ * and its options, with fixed seeds so that every run does the same work:
+ *   first      first-bulksend --RngRun=1 --writeForPlot=0
+ *   dumbbell-5k pi-dumbbell --RngRun=1 --tcpSources=5000 --simDuration=10 @tolerance=0.3
+ * Each scenario runs --repeat times, one run at a time, and the fastest
+ * run is kept. Its wall time, the time of Simulator::Run, the simulator
+ * events per second, the peak RSS and the PI hot-path counts (packets
+ * enqueued, controller updates) from the PI-SUMMARY line go to
+ * <out>/results.json; the output of each run is in <out>/<name>.
+ *
+ * With --baseline=file.json (a results.json kept from an earlier run on
+ * the same machine) a scenario fails when its wall time or peak RSS
+ * exceeds the baseline by more than --tolerance (or the @tolerance of
+ * the line), or its events per second fall below the baseline by as
+ * much. Different event or PI call counts mean the scenario itself has
+ * changed; they are reported, and the baseline should be renewed. The
+ * exit code is 1 if any scenario failed or did not run.
+ *
+ * ns-3 must be built beforehand: runs use "ns3 run --no-build", and
+ * --command changes the command template as in tools/pi-sweep.
+*/
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Сценарий из файла набора
+struct Scenario
+{
+	string name;                    // имя, оно же каталог вывода
+	string program;                 // скрипт
+	string args;                    // его опции
+	double tolerance;               // допуск, < 0 - общий --tolerance
+};
+
+// Измерения одного сценария
+struct Result
+{
+	string name;
+	map<string, double> values;     // поля из Fields, отсутствующие - NAN
+	int status;                     // код завершения лучшего запуска
+};
+
+// Поля результата в порядке вывода
+static const char *Fields[] = {"wallSeconds", "runSeconds", "events", "eventsPerSecond", "peakRssKb",
+                               "enqueues", "controllerUpdates"};
+
+// Замена всех вхождений key в text на value
+string Replace (string text, const string &key, const string &value)
+{
+	for (size_t pos = text.find (key); pos != string::npos; pos = text.find (key, pos + value.size ())) {
+		text.replace (pos, key.size (), value);
+	}
+	return text;
+}
+
+// Запуск команды через sh с выводом в файлы. Наибольшая память берётся
+// из wait4: это наибольшая из памяти процесса и его дочерних процессов
+int Execute (const string &command, const string &out, const string &err, double &seconds, long &maxRssKb)
+{
+	auto start = chrono::steady_clock::now ();
+	pid_t pid = fork ();
+	if (pid == 0) {
+		int o = open (out.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		int e = open (err.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (o < 0 || e < 0) {
+			_exit (126);
+		}
+		dup2 (o, 1);
+		dup2 (e, 2);
+		execl ("/bin/sh", "sh", "-c", command.c_str (), (char *) 0);
+		_exit (127);
+	}
+	if (pid < 0) {
+		return -1;
+	}
+	int status;
+	struct rusage usage;
+	while (wait4 (pid, &status, 0, &usage) < 0) {
+		if (errno != EINTR) {
+			return -1;
+		}
+	}
+	seconds = chrono::duration<double> (chrono::steady_clock::now () - start).count ();
+	maxRssKb = usage.ru_maxrss;
+	return WIFEXITED (status) ? WEXITSTATUS (status) : 128 + WTERMSIG (status);
+}
+
+// Поля строки PI-SUMMARY в файле вывода
+map<string, double> ReadSummary (const string &fileName)
+{
+	map<string, double> summary;
+	ifstream in (fileName);
+	string line;
+	while (getline (in, line)) {
+		if (line.compare (0, 10, "PI-SUMMARY") != 0) {
+			continue;
+		}
+		summary.clear ();
+		stringstream fields (line.substr (10));
+		string field;
+		while (fields >> field) {
+			size_t eq = field.find ('=');
+			char *end;
+			double v = (eq == string::npos) ? 0 : strtod (field.c_str () + eq + 1, &end);
+			if (eq != string::npos && end != field.c_str () + eq + 1 && *end == 0) {
+				summary[field.substr (0, eq)] = v;
+			}
+		}
+	}
+	return summary;
+}
+
+// Чтение файла набора
+bool ReadSuite (const string &fileName, vector<Scenario> &suite)
+{
+	ifstream in (fileName);
+	if (!in) {
+		return false;
+	}
+	string line;
+	while (getline (in, line)) {
+		line = line.substr (0, line.find ('#'));
+		stringstream words (line);
+		Scenario s;
+		s.tolerance = -1;
+		if (!(words >> s.name >> s.program)) {
+			continue;
+		}
+		string word;
+		while (words >> word) {
+			if (word.compare (0, 11, "@tolerance=") == 0) {
+				s.tolerance = strtod (word.c_str () + 11, 0);
+			} else {
+				s.args += (s.args.empty () ? "" : " ") + word;
+			}
+		}
+		suite.push_back (s);
+	}
+	return true;
+}
+
+// Модель процессора, чтобы не сравнивать с базой с другой машины
+string CpuModel (void)
+{
+	ifstream in ("/proc/cpuinfo");
+	string line;
+	while (getline (in, line)) {
+		if (line.compare (0, 10, "model name") == 0) {
+			size_t colon = line.find (':');
+			return colon == string::npos ? "" : line.substr (line.find_first_not_of (" \t", colon + 1));
+		}
+	}
+	return "";
+}
+
+// Строка JSON в кавычках
+string Quote (const string &text)
+{
+	string quoted = "\"";
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			quoted += '\\';
+		}
+		quoted += c;
+	}
+	return quoted + "\"";
+}
+
+void WriteJson (FILE *out, const string &cpu, const vector<Scenario> &suite, const vector<Result> &results)
+{
+	fprintf (out, "{\n  \"cpu\": %s,\n  \"scenarios\": [\n", Quote (cpu).c_str ());
+	for (size_t i = 0; i < results.size (); i++) {
+		const Result &r = results[i];
+		fprintf (out, "    {\"name\": %s, \"program\": %s, \"args\": %s, \"status\": %d", Quote (r.name).c_str (),
+		         Quote (suite[i].program).c_str (), Quote (suite[i].args).c_str (), r.status);
+		for (const char *f : Fields) {
+			double v = r.values.at (f);
+			if (!std::isnan (v)) {
+				fprintf (out, ", \"%s\": %.9g", f, v);
+			}
+		}
+		fprintf (out, "}%s\n", i + 1 < results.size () ? "," : "");
+	}
+	fprintf (out, "  ]\n}\n");
+}
+
+// Чтение results.json: объекты с полем name и числовые поля в них.
+// Понимает только то, что пишет WriteJson
+bool ReadJson (const string &fileName, string &cpu, map<string, map<string, double> > &scenarios)
+{
+	ifstream in (fileName);
+	if (!in) {
+		return false;
+	}
+	stringstream text;
+	text << in.rdbuf ();
+	string s = text.str ();
+
+	vector<map<string, string> > stack;
+	string key;
+	for (size_t i = 0; i < s.size (); i++) {
+		char c = s[i];
+		if (c == '{') {
+			stack.push_back (map<string, string> ());
+			key.clear ();
+		} else if (c == '}' && !stack.empty ()) {
+			map<string, string> object = stack.back ();
+			stack.pop_back ();
+			if (stack.empty () && object.count ("cpu")) {
+				cpu = object["cpu"];
+			}
+			if (object.count ("name")) {
+				map<string, double> &values = scenarios[object["name"]];
+				for (const auto &kv : object) {
+					char *end;
+					double v = strtod (kv.second.c_str (), &end);
+					if (end != kv.second.c_str () && *end == 0) {
+						values[kv.first] = v;
+					}
+				}
+			}
+		} else if (c == '"' || (key.size () && (isdigit (c) || c == '-'))) {
+			// Строка или число
+			string token;
+			if (c == '"') {
+				for (i++; i < s.size () && s[i] != '"'; i++) {
+					token += (s[i] == '\\' && i + 1 < s.size ()) ? s[++i] : s[i];
+				}
+			} else {
+				for (; i < s.size () && !strchr (",}] \n\t", s[i]); i++) {
+					token += s[i];
+				}
+				i--;
+			}
+			size_t next = s.find_first_not_of (" \t\n", i + 1);
+			if (key.empty () && next != string::npos && s[next] == ':') {
+				key = token;
+				i = next;
+			} else if (!key.empty ()) {
+				if (!stack.empty ()) {
+					stack.back ()[key] = token;
+				}
+				key.clear ();
+			}
+		} else if (c == '[') {
+			key.clear ();
+		}
+	}
+	return true;
+}
+
+int main (int argc, char *argv[])
+{
+	string suiteFile = "./pi/perf.suite";
+	string outDir = "./pi/perf";
+	string baselineFile;
+	string command = "./../ns3 run --no-build \"{program} {args}\"";
+	uint32_t repeat = 3;
+	double tolerance = 0.2;
+
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		size_t eq = arg.find ('=');
+		string name = (arg.compare (0, 2, "--") == 0 && eq != string::npos) ? arg.substr (2, eq - 2) : "";
+		string value = name.empty () ? "" : arg.substr (eq + 1);
+		if (name == "suite") {
+			suiteFile = value;
+		} else if (name == "out") {
+			outDir = value;
+		} else if (name == "baseline") {
+			baselineFile = value;
+		} else if (name == "command") {
+			command = value;
+		} else if (name == "repeat") {
+			repeat = strtoul (value.c_str (), 0, 10);
+		} else if (name == "tolerance") {
+			tolerance = strtod (value.c_str (), 0);
+		} else {
+			repeat = 0;
+		}
+	}
+	vector<Scenario> suite;
+	if (repeat == 0 || tolerance < 0 || !ReadSuite (suiteFile, suite) || suite.empty ()) {
+		fprintf (stderr, "usage: %s [--suite=./pi/perf.suite] [--out=./pi/perf] [--baseline=results.json]"
+		         " [--repeat=3] [--tolerance=0.2] [--command=template]\n", argv[0]);
+		return 1;
+	}
+
+	string cpu = CpuModel ();
+	string baseCpu;
+	map<string, map<string, double> > baseline;
+	if (!baselineFile.empty () && !ReadJson (baselineFile, baseCpu, baseline)) {
+		fprintf (stderr, "cannot read the baseline %s\n", baselineFile.c_str ());
+		return 1;
+	}
+	if (!baselineFile.empty () && baseCpu != cpu) {
+		fprintf (stderr, "warning: the baseline was measured on \"%s\", this is \"%s\"\n", baseCpu.c_str (), cpu.c_str ());
+	}
+
+	// Запуски по одному, чтобы они не мешали друг другу
+	vector<Result> results;
+	bool failed = false;
+	for (const Scenario &s : suite) {
+		// ns3 run запускает скрипт из корня ns-3, поэтому путь абсолютный
+		string dir = filesystem::absolute (outDir + "/" + s.name).string ();
+		filesystem::create_directories (dir);
+		Result best;
+		best.name = s.name;
+		best.status = -1;
+		for (uint32_t k = 0; k < repeat; k++) {
+			string cmd = Replace (Replace (command, "{program}", s.program), "{args}", s.args + " --pathOut=" + dir);
+			double seconds = 0;
+			long rssKb = 0;
+			int status = Execute (cmd, dir + "/stdout.txt", dir + "/stderr.txt", seconds, rssKb);
+			map<string, double> summary = ReadSummary (dir + "/stdout.txt");
+			bool better = best.status != 0 || (status == 0 && seconds < best.values["wallSeconds"]);
+			if (!better) {
+				continue;
+			}
+			best.status = status;
+			for (const char *f : Fields) {
+				best.values[f] = summary.count (f) ? summary[f] : NAN;
+			}
+			best.values["wallSeconds"] = seconds;
+			// Память самого скрипта точнее: wait4 видит ещё и обёртку ns3
+			if (std::isnan (best.values["peakRssKb"])) {
+				best.values["peakRssKb"] = rssKb;
+			}
+			double run = best.values["runSeconds"];
+			best.values["eventsPerSecond"] = run > 0 ? best.values["events"] / run : NAN;
+		}
+		failed = failed || best.status != 0;
+		fprintf (stderr, "%-16s %s: %.3f s\n", s.name.c_str (), best.status == 0 ? "ok" : "FAILED",
+		         best.values["wallSeconds"]);
+		results.push_back (best);
+	}
+
+	string jsonFile = outDir + "/results.json";
+	FILE *json = fopen (jsonFile.c_str (), "w");
+	if (!json) {
+		perror (jsonFile.c_str ());
+		return 1;
+	}
+	WriteJson (json, cpu, suite, results);
+	fclose (json);
+	printf ("results in %s\n", jsonFile.c_str ());
+
+	if (baselineFile.empty ()) {
+		return failed ? 1 : 0;
+	}
+
+	// Сравнение с базой
+	printf ("%-16s %-18s %14s %14s %9s  %s\n", "scenario", "metric", "baseline", "now", "change", "verdict");
+	for (size_t i = 0; i < results.size (); i++) {
+		const Result &r = results[i];
+		double tol = suite[i].tolerance >= 0 ? suite[i].tolerance : tolerance;
+		if (baseline.count (r.name) == 0) {
+			printf ("%-16s no baseline\n", r.name.c_str ());
+			continue;
+		}
+		map<string, double> &base = baseline[r.name];
+		for (const char *f : Fields) {
+			string field = f;
+			double now = r.values.at (f);
+			if (base.count (field) == 0 || std::isnan (now)) {
+				continue;
+			}
+			double was = base[field];
+			double change = was != 0 ? now / was - 1 : 0;
+			const char *verdict = "";
+			if (field == "wallSeconds" || field == "peakRssKb") {
+				verdict = now > was * (1 + tol) ? "FAIL" : "ok";
+			} else if (field == "eventsPerSecond") {
+				verdict = now < was / (1 + tol) ? "FAIL" : "ok";
+			} else if (field == "events" || field == "enqueues" || field == "controllerUpdates") {
+				verdict = now != was ? "changed" : "";
+			}
+			failed = failed || strcmp (verdict, "FAIL") == 0;
+			printf ("%-16s %-18s %14.6g %14.6g %+8.1f%%  %s\n", r.name.c_str (), f, was, now, 100 * change, verdict);
+		}
+	}
+	printf ("%s\n", failed ? "FAILED" : "passed");
+	return failed ? 1 : 0;
+}
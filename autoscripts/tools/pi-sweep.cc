@@ -0,0 +1,553 @@
+/*
+ * Parameter sweep over the traffic scripts on all local cores.
+ *
+ * Every combination of the grid is a job: the script runs with
+ * --pathOut set to the job's own directory (job-NNNN under --out) and
+ * --name=value for each parameter. Its output goes to stdout.txt and
+ * stderr.txt there, and the PI-SUMMARY line it prints ends up in
+ * <out>/summary.txt together with the parameters of the job.
+ *
+ * The grid is given as name=v1,v2,... on the command line and/or in a
+ * file (--grid) with one such line per parameter and # comments:
+ *   ./tools/pi-sweep --program=first-bulksend --grid=./pi/sweep.grid --jobs=8
+ *   ./tools/pi-sweep --program=second-bulksend queueRef=30,50 A=0.00001822,0.00003644
+ *
+ * With --replications=K every job is repeated with --RngRun=1..K, each
+ * run in job-NNNN/run-RR. <out>/runs.txt then lists every run, and
+ * summary.txt the mean of every PI-SUMMARY field over the runs of a job
+ * with the half-width of its confidence interval (Student t, level
+ * --confidence). With --ci-target=X a job stops early, after at least
+ * --min-replications runs, once the half-width of every --ci-metrics
+ * field is within X times its mean:
+ *   ./tools/pi-sweep --program=first-bulksend --replications=30 --ci-target=0.05
+ *
+ * ns-3 must be built beforehand: jobs run with "ns3 run --no-build" so
+ * that they do not compete for the build. --command changes the command
+ * template; {program} and {args} are replaced in it.
+*/
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Параметр сетки: имя опции скрипта и её значения
+struct Param
+{
+	string name;
+	vector<string> values;
+};
+
+// Один запуск скрипта и его результат
+struct Run
+{
+	uint32_t rngRun;                // значение --RngRun, 0 если не задаётся
+	string dir;                     // каталог для выходных файлов
+	int status;                     // код завершения, -1 если ещё выполняется
+	double seconds;                 // время выполнения
+	vector<pair<string, string> > summary;  // поля строки PI-SUMMARY
+};
+
+// Одно сочетание параметров и его повторы
+struct Job
+{
+	vector<string> values;          // значения параметров в порядке сетки
+	string dir;                     // каталог задания
+	vector<Run> runs;               // начатые запуски
+	uint32_t running;               // сколько из них ещё выполняется
+	bool done;                      // новые запуски не нужны
+};
+
+// Разбор строки имя=v1,v2,...
+bool ParseParam (const string &text, Param &param)
+{
+	size_t eq = text.find ('=');
+	if (eq == string::npos || eq == 0) {
+		return false;
+	}
+	param.name = text.substr (0, eq);
+	param.values.clear ();
+	stringstream values (text.substr (eq + 1));
+	string value;
+	while (getline (values, value, ',')) {
+		if (!value.empty ()) {
+			param.values.push_back (value);
+		}
+	}
+	return !param.values.empty ();
+}
+
+// Замена всех вхождений key в text на value
+string Replace (string text, const string &key, const string &value)
+{
+	for (size_t pos = text.find (key); pos != string::npos; pos = text.find (key, pos + value.size ())) {
+		text.replace (pos, key.size (), value);
+	}
+	return text;
+}
+
+// Запуск команды через sh без system (), который не обязан быть
+// потокобезопасным. Возвращает код завершения
+int Execute (const string &command)
+{
+	pid_t pid = fork ();
+	if (pid == 0) {
+		execl ("/bin/sh", "sh", "-c", command.c_str (), (char *) 0);
+		_exit (127);
+	}
+	if (pid < 0) {
+		return -1;
+	}
+	int status;
+	while (waitpid (pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			return -1;
+		}
+	}
+	return WIFEXITED (status) ? WEXITSTATUS (status) : 128 + WTERMSIG (status);
+}
+
+// Поиск строки PI-SUMMARY в выводе запуска
+void ReadSummary (Run &run)
+{
+	ifstream in (run.dir + "/stdout.txt");
+	string line;
+	while (getline (in, line)) {
+		if (line.compare (0, 10, "PI-SUMMARY") != 0) {
+			continue;
+		}
+		run.summary.clear ();
+		stringstream fields (line.substr (10));
+		string field;
+		while (fields >> field) {
+			size_t eq = field.find ('=');
+			if (eq != string::npos) {
+				string value = field.substr (eq + 1);
+				run.summary.push_back (make_pair (field.substr (0, eq), value.empty () ? "-" : value));
+			}
+		}
+	}
+}
+
+// Числовые значения поля key в успешно завершившихся запусках задания
+vector<double> Collect (const Job &job, const string &key)
+{
+	vector<double> values;
+	for (const Run &run : job.runs) {
+		if (run.status != 0) {
+			continue;
+		}
+		for (const pair<string, string> &field : run.summary) {
+			char *end;
+			double v = strtod (field.second.c_str (), &end);
+			if (field.first == key && end != field.second.c_str () && *end == 0) {
+				values.push_back (v);
+			}
+		}
+	}
+	return values;
+}
+
+// Регуляризованная неполная бета-функция I_x (a, b): непрерывная дробь
+// по методу Лентца, сходящаяся при x < (a + 1) / (a + b + 2)
+double IncompleteBeta (double a, double b, double x)
+{
+	if (x <= 0 || x >= 1) {
+		return x <= 0 ? 0 : 1;
+	}
+	if (x > (a + 1) / (a + b + 2)) {
+		return 1 - IncompleteBeta (b, a, 1 - x);
+	}
+	const double tiny = 1e-300;
+	double front = exp (lgamma (a + b) - lgamma (a) - lgamma (b) + a * log (x) + b * log (1 - x)) / a;
+	double f = 1, c = 1, d = 0;
+	for (int i = 0; i <= 400; i++) {
+		int m = i / 2;
+		double num;
+		if (i == 0) {
+			num = 1;
+		} else if (i % 2 == 0) {
+			num = m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m));
+		} else {
+			num = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+		}
+		d = 1 + num * d;
+		d = 1 / (fabs (d) < tiny ? tiny : d);
+		c = 1 + num / c;
+		c = fabs (c) < tiny ? tiny : c;
+		f *= c * d;
+		if (fabs (1 - c * d) < 1e-12) {
+			break;
+		}
+	}
+	return front * (f - 1);
+}
+
+// Квантиль уровня p > 0.5 распределения Стьюдента с df степенями свободы,
+// делением пополам по функции распределения
+double StudentQuantile (double p, double df)
+{
+	double lo = 0, hi = 1e6;
+	for (int i = 0; i < 100; i++) {
+		double t = (lo + hi) / 2;
+		double cdf = 1 - 0.5 * IncompleteBeta (df / 2, 0.5, df / (df + t * t));
+		if (cdf < p) {
+			lo = t;
+		} else {
+			hi = t;
+		}
+	}
+	return (lo + hi) / 2;
+}
+
+// Среднее и половина ширины доверительного интервала; при одном значении
+// половина ширины - NAN
+void Interval (const vector<double> &values, double confidence, double &mean, double &halfWidth)
+{
+	size_t n = values.size ();
+	mean = 0;
+	for (double v : values) {
+		mean += v;
+	}
+	mean = n ? mean / n : 0;
+	halfWidth = NAN;
+	if (n < 2) {
+		return;
+	}
+	double ss = 0;
+	for (double v : values) {
+		ss += (v - mean) * (v - mean);
+	}
+	halfWidth = StudentQuantile (0.5 + confidence / 2, n - 1) * sqrt (ss / (n - 1) / n);
+}
+
+int main (int argc, char *argv[])
+{
+	// Имя скрипта в scratch
+	string program;
+	// Каталог для результатов
+	string out = "./pi/sweep";
+	// Количество одновременно выполняемых запусков
+	unsigned jobsMax = thread::hardware_concurrency ();
+	// Шаблон команды одного запуска
+	string command = "./../ns3 run --no-build \"{program} {args}\"";
+	// Наибольшее и наименьшее количество повторов каждого задания
+	uint32_t replications = 1;
+	uint32_t minReplications = 3;
+	// Доверительная вероятность интервалов
+	double confidence = 0.95;
+	// Допустимая половина ширины интервала относительно среднего, 0 - всегда все повторы
+	double ciTarget = 0;
+	// Поля PI-SUMMARY, по которым решается, достаточно ли повторов
+	string ciMetrics = "meanQueue,unforcedDrop,throughputBps";
+	vector<Param> grid;
+
+	bool ok = true;
+	for (int i = 1; i < argc && ok; i++) {
+		string arg = argv[i];
+		Param param;
+		if (arg.compare (0, 10, "--program=") == 0) {
+			program = arg.substr (10);
+		} else if (arg.compare (0, 6, "--out=") == 0) {
+			out = arg.substr (6);
+		} else if (arg.compare (0, 7, "--jobs=") == 0) {
+			jobsMax = strtoul (arg.c_str () + 7, 0, 10);
+		} else if (arg.compare (0, 10, "--command=") == 0) {
+			command = arg.substr (10);
+		} else if (arg.compare (0, 15, "--replications=") == 0) {
+			replications = strtoul (arg.c_str () + 15, 0, 10);
+		} else if (arg.compare (0, 19, "--min-replications=") == 0) {
+			minReplications = strtoul (arg.c_str () + 19, 0, 10);
+		} else if (arg.compare (0, 13, "--confidence=") == 0) {
+			confidence = strtod (arg.c_str () + 13, 0);
+		} else if (arg.compare (0, 12, "--ci-target=") == 0) {
+			ciTarget = strtod (arg.c_str () + 12, 0);
+		} else if (arg.compare (0, 13, "--ci-metrics=") == 0) {
+			ciMetrics = arg.substr (13);
+		} else if (arg.compare (0, 7, "--grid=") == 0) {
+			ifstream in (arg.substr (7));
+			ok = in.good ();
+			string line;
+			while (ok && getline (in, line)) {
+				line = line.substr (0, line.find ('#'));
+				line.erase (0, line.find_first_not_of (" \t"));
+				line.erase (line.find_last_not_of (" \t\r") + 1);
+				if (!line.empty ()) {
+					ok = ParseParam (line, param);
+					grid.push_back (param);
+				}
+			}
+		} else if (arg.compare (0, 2, "--") != 0 && ParseParam (arg, param)) {
+			grid.push_back (param);
+		} else {
+			ok = false;
+		}
+	}
+	Param metrics;
+	if (!ok || program.empty () || jobsMax == 0 || replications == 0 || !(confidence > 0 && confidence < 1)
+	    || !ParseParam ("metrics=" + ciMetrics, metrics)) {
+		fprintf (stderr, "usage: %s --program=<script> [--grid=file] [--out=dir] [--jobs=N] [--command=template]\n"
+		         "       [--replications=K] [--min-replications=M] [--confidence=0.95] [--ci-target=X]"
+		         " [--ci-metrics=a,b,...] [name=v1,v2,...]...\n", argv[0]);
+		return 1;
+	}
+	// Интервал строится не меньше чем по двум запускам
+	minReplications = minReplications < 2 ? 2 : minReplications;
+	minReplications = minReplications > replications ? replications : minReplications;
+	bool replicated = replications > 1;
+
+	// Все сочетания значений, первый параметр меняется медленнее всех
+	vector<Job> jobs (1);
+	for (const Param &param : grid) {
+		vector<Job> expanded;
+		for (const Job &job : jobs) {
+			for (const string &value : param.values) {
+				expanded.push_back (job);
+				expanded.back ().values.push_back (value);
+			}
+		}
+		jobs.swap (expanded);
+	}
+
+	filesystem::path root = filesystem::absolute (out);
+	for (size_t i = 0; i < jobs.size (); i++) {
+		char name[32];
+		snprintf (name, sizeof (name), "job-%04zu", i);
+		jobs[i].dir = (root / name).string ();
+		jobs[i].runs.reserve (replications);
+		jobs[i].running = 0;
+		jobs[i].done = false;
+		filesystem::create_directories (jobs[i].dir);
+	}
+
+	// Достаточно ли повторов: у каждого из полей metrics, которые выводит
+	// скрипт, половина ширины интервала не больше ciTarget от среднего
+	auto precise = [&] (const Job &job) {
+		bool any = false;
+		for (const string &key : metrics.values) {
+			vector<double> values = Collect (job, key);
+			if (values.empty ()) {
+				continue;
+			}
+			double mean, halfWidth;
+			Interval (values, confidence, mean, halfWidth);
+			if (values.size () < minReplications || !(halfWidth <= ciTarget * fabs (mean))) {
+				return false;
+			}
+			any = true;
+		}
+		return any;
+	};
+
+	// Выбор задания для следующего запуска, по порядку. Сначала те, без
+	// которых не обойтись: пока нет minReplications запусков, или все
+	// запуски завершились, а точности не хватает. Если таких нет, ещё один
+	// повтор задания, точность которого пока не известна, чтобы не
+	// простаивали ядра. -1, если запускать нечего
+	auto pick = [&] () {
+		for (int pass = 0; pass < 2; pass++) {
+			for (size_t i = 0; i < jobs.size (); i++) {
+				const Job &job = jobs[i];
+				if (job.done || job.runs.size () >= replications) {
+					continue;
+				}
+				if (pass == 1 || job.runs.size () < minReplications || job.running == 0) {
+					return (int) i;
+				}
+			}
+		}
+		return -1;
+	};
+
+	// Пул потоков: каждый берёт следующий запуск, пока они не кончатся.
+	// Поток, которому нечего запускать, ждёт завершения чужих запусков:
+	// после них могут понадобиться новые повторы
+	mutex lock;
+	condition_variable finished;
+	uint32_t running = 0;
+	size_t done = 0;
+	auto start = chrono::steady_clock::now ();
+	auto worker = [&] () {
+		unique_lock<mutex> guard (lock);
+		while (true) {
+			int i = pick ();
+			if (i < 0) {
+				if (running == 0) {
+					return;
+				}
+				finished.wait (guard);
+				continue;
+			}
+
+			Job &job = jobs[i];
+			size_t r = job.runs.size ();
+			job.runs.push_back (Run ());
+			Run &run = job.runs.back ();
+			run.rngRun = replicated ? r + 1 : 0;
+			run.status = -1;
+			run.seconds = 0;
+			run.dir = job.dir;
+			if (replicated) {
+				char name[32];
+				snprintf (name, sizeof (name), "/run-%02zu", r + 1);
+				run.dir += name;
+			}
+			string args = "--pathOut=" + run.dir;
+			if (replicated) {
+				args += " --RngRun=" + to_string (run.rngRun);
+			}
+			for (size_t k = 0; k < grid.size (); k++) {
+				args += " --" + grid[k].name + "=" + job.values[k];
+			}
+			string dir = run.dir;
+			string cmd = "(" + Replace (Replace (command, "{program}", program), "{args}", args) + ")"
+				+ " > " + dir + "/stdout.txt 2> " + dir + "/stderr.txt";
+			job.running++;
+			running++;
+			guard.unlock ();
+
+			// Сам запуск - без блокировки. Вектор runs зарезервирован
+			// заранее, так что ссылки на его элементы не меняются
+			Run result;
+			result.dir = dir;
+			filesystem::create_directories (dir);
+			auto runStart = chrono::steady_clock::now ();
+			result.status = Execute (cmd);
+			result.seconds = chrono::duration<double> (chrono::steady_clock::now () - runStart).count ();
+			ReadSummary (result);
+
+			guard.lock ();
+			job.runs[r].status = result.status;
+			job.runs[r].seconds = result.seconds;
+			job.runs[r].summary.swap (result.summary);
+			job.running--;
+			running--;
+			job.done = job.runs.size () >= replications || (ciTarget > 0 && precise (job));
+			fprintf (stderr, "[%zu/%zu] %s %s %.1f s\n", ++done, jobs.size () * replications, dir.c_str (),
+			         result.status == 0 ? "ok" : "FAILED", result.seconds);
+			finished.notify_all ();
+		}
+	};
+	vector<thread> pool;
+	for (unsigned t = 0; t < jobsMax && t < jobs.size () * replications; t++) {
+		pool.push_back (thread (worker));
+	}
+	for (thread &t : pool) {
+		t.join ();
+	}
+	double wall = chrono::duration<double> (chrono::steady_clock::now () - start).count ();
+
+	// Поля PI-SUMMARY всех запусков в порядке появления
+	vector<string> keys;
+	map<string, bool> known;
+	for (const Job &job : jobs) {
+		for (const Run &run : job.runs) {
+			for (const pair<string, string> &field : run.summary) {
+				if (!known[field.first]) {
+					known[field.first] = true;
+					keys.push_back (field.first);
+				}
+			}
+		}
+	}
+
+	// Таблица запусков: параметры и поля PI-SUMMARY. Без повторов это
+	// и есть сводная таблица
+	string summaryFile = (root / "summary.txt").string ();
+	string runsFile = replicated ? (root / "runs.txt").string () : summaryFile;
+	ofstream runs (runsFile);
+	runs << (replicated ? "# job rngRun status seconds" : "# job status seconds");
+	for (const Param &param : grid) {
+		runs << " " << param.name;
+	}
+	for (const string &key : keys) {
+		runs << " " << key;
+	}
+	runs << endl;
+
+	size_t failed = 0, total = 0;
+	double cpu = 0;
+	for (size_t i = 0; i < jobs.size (); i++) {
+		for (const Run &run : jobs[i].runs) {
+			total++;
+			failed += run.status != 0;
+			cpu += run.seconds;
+			runs << i;
+			if (replicated) {
+				runs << " " << run.rngRun;
+			}
+			runs << " " << run.status << " " << run.seconds;
+			for (const string &value : jobs[i].values) {
+				runs << " " << value;
+			}
+			for (const string &key : keys) {
+				string value = "-";
+				for (const pair<string, string> &field : run.summary) {
+					value = (field.first == key) ? field.second : value;
+				}
+				runs << " " << value;
+			}
+			runs << endl;
+		}
+	}
+
+	// Сводная таблица повторов: по каждому полю среднее и половина ширины
+	// интервала (поле_ci) по успешным запускам задания
+	if (replicated) {
+		ofstream summary (summaryFile);
+		summary << "# job runs failed seconds";
+		for (const Param &param : grid) {
+			summary << " " << param.name;
+		}
+		for (const string &key : keys) {
+			summary << " " << key << " " << key << "_ci";
+		}
+		summary << endl;
+
+		for (size_t i = 0; i < jobs.size (); i++) {
+			const Job &job = jobs[i];
+			size_t jobFailed = 0;
+			double seconds = 0;
+			for (const Run &run : job.runs) {
+				jobFailed += run.status != 0;
+				seconds += run.seconds;
+			}
+			summary << i << " " << job.runs.size () << " " << jobFailed << " " << seconds;
+			for (const string &value : job.values) {
+				summary << " " << value;
+			}
+			for (const string &key : keys) {
+				vector<double> values = Collect (job, key);
+				double mean, halfWidth;
+				Interval (values, confidence, mean, halfWidth);
+				if (values.empty ()) {
+					summary << " - -";
+				} else if (std::isnan (halfWidth)) {
+					summary << " " << mean << " -";
+				} else {
+					summary << " " << mean << " " << halfWidth;
+				}
+			}
+			summary << endl;
+		}
+	}
+
+	fprintf (stderr, "%zu jobs, %zu runs (%zu failed) on %u workers: %.1f s wall, %.1f s in runs, summary in %s\n",
+	         jobs.size (), total, failed, jobsMax, wall, cpu, summaryFile.c_str ());
+	return failed ? 1 : 0;
+}
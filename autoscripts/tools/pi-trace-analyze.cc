@@ -0,0 +1,465 @@
+/*
+ * One pass over a queue trace of the traffic scripts (.plotme text or the
+ * binary .pitrace of --binaryTrace=1) with memory that does not depend on
+ * the length of the trace.
+ *
+ * It prints the control metrics of the queue length q against QueueRef:
+ *   riseTime     - from the first time q reaches 10% of QueueRef to the
+ *                  first time it reaches 90%
+ *   overshoot    - (max q - QueueRef) / QueueRef after q first reaches QueueRef
+ *   settlingTime - time after which q stays within --band of QueueRef
+ *   steadyError  - mean q - QueueRef in the steady window
+ *   variance     - variance of q in the steady window
+ * riseTime, overshoot and settlingTime use q smoothed with a time constant
+ * of --smooth seconds (0 - the raw samples), otherwise a single TCP burst
+ * decides them. They are -1 if q never gets there. The steady window is
+ * the second half of the trace, as in tools/pi-fluid, or starts at
+ * --steadyFrom seconds.
+ *
+ * With --out it also writes a shape-preserving downsampled trace (Largest
+ * Triangle Three Buckets over q, one sample per --bucket seconds) in the
+ * .plotme layout, which gnuplot draws in place of the full one:
+ *   ./tools/pi-trace-analyze --out=./pi/raw/pi-queue1-TcpNewReno-lttb.plotme ./pi/raw/pi-queue1-TcpNewReno.pitrace
+ *   gnuplot -c ./pi/pi-queue1 TcpNewReno-lttb
+*/
+
+#include "pi-trace-writer.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+using namespace std;
+
+typedef PiTraceWriter::Sample Sample;
+
+// Прореживание Largest Triangle Three Buckets по ходу чтения. Выборки
+// делятся на интервалы по времени; из каждого интервала берётся выборка,
+// образующая наибольший треугольник с выбранной в предыдущем интервале и
+// средней точкой следующего. Поэтому в памяти только два интервала
+class Decimator
+{
+public:
+	Decimator (FILE *out, double bucket, int columns)
+		: m_out (out), m_bucket (bucket), m_columns (columns), m_started (false), m_t0 (0), m_nextIndex (0), m_written (0)
+	{
+	}
+
+	void Add (const Sample &s)
+	{
+		if (!m_started) {
+			// Первая выборка остаётся всегда
+			m_started = true;
+			m_t0 = s.time;
+			m_a = s;
+			Write (s);
+			return;
+		}
+		// Поправка на округление: время 0.3 при интервале 0.1 - начало интервала 3
+		int64_t index = (int64_t) floor ((s.time - m_t0) / m_bucket + 1e-9);
+		if (!m_next.empty () && index != m_nextIndex) {
+			if (!m_cur.empty ()) {
+				Sample c = Mean (m_next);
+				Select (m_cur, c);
+			}
+			m_cur.swap (m_next);
+			m_next.clear ();
+		}
+		if (m_next.empty ()) {
+			m_nextIndex = index;
+		}
+		m_next.push_back (s);
+	}
+
+	// Дописать оставшиеся интервалы; последняя выборка остаётся всегда
+	void Finish (void)
+	{
+		if (!m_cur.empty ()) {
+			Select (m_cur, m_next.empty () ? m_cur.back () : Mean (m_next));
+		}
+		if (!m_next.empty ()) {
+			Sample last = m_next.back ();
+			m_next.pop_back ();
+			if (!m_next.empty ()) {
+				Select (m_next, last);
+			}
+			Write (last);
+		}
+		m_cur.clear ();
+		m_next.clear ();
+	}
+
+	uint64_t GetWritten (void) const
+	{
+		return m_written;
+	}
+
+private:
+	static Sample Mean (const vector<Sample> &bucket)
+	{
+		Sample m = {0, 0, 0, 0, 0};
+		for (const Sample &s : bucket) {
+			m.time += s.time;
+			m.qlen += s.qlen;
+		}
+		m.time /= bucket.size ();
+		m.qlen /= bucket.size ();
+		return m;
+	}
+
+	// Выборка интервала с наибольшей площадью треугольника (m_a, s, c)
+	void Select (const vector<Sample> &bucket, const Sample &c)
+	{
+		size_t best = 0;
+		double bestArea = -1;
+		for (size_t i = 0; i < bucket.size (); i++) {
+			const Sample &s = bucket[i];
+			double area = fabs ((m_a.time - c.time) * (s.qlen - m_a.qlen) - (m_a.time - s.time) * (c.qlen - m_a.qlen));
+			if (area > bestArea) {
+				bestArea = area;
+				best = i;
+			}
+		}
+		m_a = bucket[best];
+		Write (m_a);
+	}
+
+	void Write (const Sample &s)
+	{
+		if (m_columns > 3) {
+			fprintf (m_out, "%g %g %g %g %llu\n", s.time, s.qlen, s.avg, s.p, (unsigned long long) s.drops);
+		} else {
+			fprintf (m_out, "%g %g %g\n", s.time, s.qlen, s.avg);
+		}
+		m_written++;
+	}
+
+	FILE *m_out;                // файл для прореженной трассы
+	double m_bucket;            // ширина интервала, с
+	int m_columns;              // столбцов во входной трассе
+	bool m_started;             // первая выборка уже записана
+	double m_t0;                // время первой выборки
+	Sample m_a;                 // последняя записанная выборка
+	vector<Sample> m_cur;       // интервал, из которого выбирается следующая выборка
+	vector<Sample> m_next;      // следующий за ним интервал
+	int64_t m_nextIndex;        // номер интервала m_next
+	uint64_t m_written;         // записано выборок
+};
+
+// Сумма и сумма квадратов длины очереди за отрезок времени
+struct Block
+{
+	double start;
+	uint64_t n;
+	double sum;
+	double sumSq;
+};
+
+// Показатели регулирования по ходу чтения
+class Metrics
+{
+public:
+	Metrics (double queueRef, double band, double smooth, double steadyFrom)
+		: m_ref (queueRef), m_band (band), m_smooth (smooth), m_steadyFrom (steadyFrom),
+		  m_samples (0), m_t0 (0), m_last (0), m_smoothed (0), m_rise10 (-1), m_rise90 (-1), m_reached (-1), m_peak (0), m_settling (0),
+		  m_blockWidth (0)
+	{
+	}
+
+	void Add (const Sample &s)
+	{
+		if (m_samples == 0) {
+			m_t0 = s.time;
+			m_smoothed = s.qlen;
+		} else if (m_smooth > 0) {
+			// Экспоненциальное сглаживание с учётом неравных промежутков
+			double w = exp (-(s.time - m_last) / m_smooth);
+			m_smoothed = w * m_smoothed + (1 - w) * s.qlen;
+		} else {
+			m_smoothed = s.qlen;
+		}
+		m_samples++;
+		m_last = s.time;
+		double t = s.time - m_t0;
+		double q = m_smoothed;
+
+		if (m_rise10 < 0 && q >= 0.1 * m_ref) {
+			m_rise10 = t;
+		}
+		if (m_rise90 < 0 && q >= 0.9 * m_ref) {
+			m_rise90 = t;
+		}
+		if (m_reached < 0 && q >= m_ref) {
+			m_reached = t;
+		}
+		if (m_reached >= 0 && q > m_peak) {
+			m_peak = q;
+		}
+		if (fabs (q - m_ref) > m_band * m_ref) {
+			m_settling = t;
+		}
+		AddSteady (t, s.qlen);
+	}
+
+	void Print (FILE *out) const
+	{
+		// Установившийся режим: с --steadyFrom или со второй половины трассы
+		double duration = m_last - m_t0;
+		double from = m_steadyFrom >= 0 ? m_steadyFrom : duration / 2;
+		uint64_t n = 0;
+		double sum = 0, sumSq = 0;
+		for (const Block &b : m_blocks) {
+			if (b.start >= from || m_steadyFrom >= 0) {
+				n += b.n;
+				sum += b.sum;
+				sumSq += b.sumSq;
+			}
+		}
+		double mean = n ? sum / n : 0;
+		double variance = n ? fmax (0, sumSq / n - mean * mean) : 0;
+		double steadyStart = from;
+		for (const Block &b : m_blocks) {
+			if (b.start >= from) {
+				steadyStart = b.start;
+				break;
+			}
+		}
+
+		fprintf (out, "PI-METRICS samples=%llu duration=%g queueRef=%g riseTime=%g overshoot=%g settlingTime=%g"
+		         " steadyFrom=%g steadyMean=%g steadyError=%g variance=%g\n",
+		         (unsigned long long) m_samples, duration, m_ref,
+		         (m_rise10 >= 0 && m_rise90 >= 0) ? m_rise90 - m_rise10 : -1,
+		         m_reached >= 0 ? (m_peak - m_ref) / m_ref : -1,
+		         m_samples ? m_settling : -1,
+		         m_steadyFrom >= 0 ? m_steadyFrom : steadyStart, mean, n ? mean - m_ref : 0, variance);
+	}
+
+private:
+	// Суммы копятся по отрезкам времени. Когда отрезков становится больше
+	// kMaxBlocks, соседние объединяются и ширина удваивается, так что к
+	// концу трассы её вторая половина известна с точностью до отрезка
+	// (не хуже 1/128 длины), а память постоянна. С --steadyFrom нужен один отрезок
+	void AddSteady (double t, double q)
+	{
+		if (m_steadyFrom >= 0) {
+			if (t >= m_steadyFrom) {
+				if (m_blocks.empty ()) {
+					m_blocks.push_back (Block {m_steadyFrom, 0, 0, 0});
+				}
+				Block &b = m_blocks.back ();
+				b.n++;
+				b.sum += q;
+				b.sumSq += q * q;
+			}
+			return;
+		}
+
+		if (m_blockWidth == 0) {
+			m_blockWidth = 1;
+		}
+		while (t >= (m_blocks.empty () ? 0 : m_blocks.back ().start + m_blockWidth)) {
+			double start = m_blocks.empty () ? 0 : m_blocks.back ().start + m_blockWidth;
+			if (m_blocks.size () == kMaxBlocks) {
+				Merge ();
+				continue;
+			}
+			m_blocks.push_back (Block {start, 0, 0, 0});
+		}
+		Block &b = m_blocks.back ();
+		b.n++;
+		b.sum += q;
+		b.sumSq += q * q;
+	}
+
+	void Merge (void)
+	{
+		size_t j = 0;
+		for (size_t i = 0; i < m_blocks.size (); i += 2, j++) {
+			Block b = m_blocks[i];
+			if (i + 1 < m_blocks.size ()) {
+				b.n += m_blocks[i + 1].n;
+				b.sum += m_blocks[i + 1].sum;
+				b.sumSq += m_blocks[i + 1].sumSq;
+			}
+			m_blocks[j] = b;
+		}
+		m_blocks.resize (j);
+		m_blockWidth *= 2;
+	}
+
+	static const size_t kMaxBlocks = 256;
+
+	double m_ref;               // желаемая длина очереди
+	double m_band;              // допуск для времени установления, доля m_ref
+	double m_smooth;            // постоянная времени сглаживания, с
+	double m_steadyFrom;        // начало установившегося режима, с; < 0 - вторая половина
+	uint64_t m_samples;         // прочитано выборок
+	double m_t0;                // время первой выборки
+	double m_last;              // время последней выборки
+	double m_smoothed;          // сглаженная длина очереди
+	double m_rise10;            // первое достижение 10% m_ref
+	double m_rise90;            // первое достижение 90% m_ref
+	double m_reached;           // первое достижение m_ref
+	double m_peak;              // наибольшая сглаженная длина после m_reached
+	double m_settling;          // последний выход за допуск
+	double m_blockWidth;        // ширина отрезка, с
+	vector<Block> m_blocks;     // суммы по отрезкам
+};
+
+// Разбор строки .plotme: время, длина очереди, средняя длина и, если
+// есть, вероятность и количество сбросов. Возвращает число столбцов
+int ParseLine (const char *line, Sample &s)
+{
+	double v[5] = {0, 0, 0, 0, 0};
+	int n = 0;
+	const char *p = line;
+	while (n < 5) {
+		char *end;
+		v[n] = strtod (p, &end);
+		if (end == p) {
+			break;
+		}
+		p = end;
+		n++;
+	}
+	s = Sample {v[0], v[1], v[2], v[3], (uint64_t) v[4]};
+	return n;
+}
+
+int main (int argc, char *argv[])
+{
+	// Желаемая длина очереди (QueueRef скриптов)
+	double queueRef = 50;
+	// Допуск для времени установления, доля от queueRef (10%, как в tools/pi-fluid)
+	double band = 0.1;
+	// Постоянная времени сглаживания, с
+	double smooth = 1;
+	// Начало установившегося режима, с; < 0 - вторая половина трассы
+	double steadyFrom = -1;
+	// Ширина интервала прореживания, с
+	double bucket = 0.1;
+	// Файл для прореженной трассы
+	string out;
+	string in;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *eq = strchr (arg, '=');
+		bool ok = true;
+		if (strncmp (arg, "--", 2) != 0) {
+			ok = in.empty ();
+			in = arg;
+		} else if (!eq) {
+			ok = false;
+		} else {
+			string name (arg + 2, eq);
+			if (name == "queueRef") {
+				queueRef = strtod (eq + 1, 0);
+			} else if (name == "band") {
+				band = strtod (eq + 1, 0);
+			} else if (name == "smooth") {
+				smooth = strtod (eq + 1, 0);
+			} else if (name == "steadyFrom") {
+				steadyFrom = strtod (eq + 1, 0);
+			} else if (name == "bucket") {
+				bucket = strtod (eq + 1, 0);
+			} else if (name == "out") {
+				out = eq + 1;
+			} else {
+				ok = false;
+			}
+		}
+		if (!ok) {
+			fprintf (stderr, "usage: %s [--queueRef=50] [--band=0.1] [--smooth=s] [--steadyFrom=s] [--bucket=s]"
+			         " [--out=decimated.plotme] <trace.plotme|trace.pitrace>\n", argv[0]);
+			return 1;
+		}
+	}
+	if (in.empty () || queueRef <= 0 || bucket <= 0 || band < 0 || smooth < 0) {
+		fprintf (stderr, "a trace file is needed; --queueRef and --bucket must be positive, --band and --smooth non-negative\n");
+		return 1;
+	}
+
+	ifstream binary (in.c_str (), ios::in | ios::binary);
+	if (!binary) {
+		perror (in.c_str ());
+		return 1;
+	}
+	uint32_t maxBlock = 0;
+	bool isBinary = PiTraceWriter::ReadHeader (binary, maxBlock);
+
+	FILE *text = 0;
+	if (!isBinary) {
+		binary.close ();
+		text = fopen (in.c_str (), "r");
+		if (!text) {
+			perror (in.c_str ());
+			return 1;
+		}
+	}
+
+	FILE *decimated = 0;
+	if (!out.empty ()) {
+		decimated = fopen (out.c_str (), "w");
+		if (!decimated) {
+			perror (out.c_str ());
+			return 1;
+		}
+	}
+
+	Metrics metrics (queueRef, band, smooth, steadyFrom);
+	unique_ptr<Decimator> decimator;
+	if (isBinary) {
+		// Блоки читаются по одному
+		if (decimated) {
+			decimator.reset (new Decimator (decimated, bucket, 5));
+		}
+		vector<Sample> block;
+		while (PiTraceWriter::ReadBlock (binary, block, maxBlock)) {
+			for (const Sample &s : block) {
+				metrics.Add (s);
+				if (decimator) {
+					decimator->Add (s);
+				}
+			}
+		}
+		if (binary.bad () || !binary.eof ()) {
+			fprintf (stderr, "%s: truncated or corrupt block\n", in.c_str ());
+			return 1;
+		}
+	} else {
+		// Число столбцов выходной трассы - как у первой строки входной
+		char line[512];
+		while (fgets (line, sizeof (line), text)) {
+			Sample s;
+			int columns = ParseLine (line, s);
+			if (columns < 2) {
+				continue;
+			}
+			if (decimated && !decimator) {
+				decimator.reset (new Decimator (decimated, bucket, columns));
+			}
+			metrics.Add (s);
+			if (decimator) {
+				decimator->Add (s);
+			}
+		}
+		fclose (text);
+	}
+
+	metrics.Print (stdout);
+	if (decimator) {
+		decimator->Finish ();
+		fprintf (stderr, "%s: %llu samples written\n", out.c_str (), (unsigned long long) decimator->GetWritten ());
+	}
+	if (decimated && fclose (decimated) != 0) {
+		perror (out.c_str ());
+		return 1;
+	}
+	return 0;
+}
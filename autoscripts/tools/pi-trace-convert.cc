@@ -0,0 +1,59 @@
+/*
+ * Converts a binary queue trace written by PiTraceWriter (the traffic
+ * scripts with --binaryTrace=1) into the .plotme text layout the gnuplot
+ * scripts read: time, queue length, mean queue length, drop probability
+ * and drops, one sample per line.
+ *
+ *   ./tools/pi-trace-convert ./pi/raw/pi-queue1-TcpNewReno.pitrace ./pi/raw/pi-queue1-TcpNewReno.plotme
+ *
+ * Without the output file the text goes to stdout. "make convert" converts
+ * every trace in ./pi/raw.
+*/
+
+#include "pi-trace-writer.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using namespace ns3;
+using namespace std;
+
+int main (int argc, char *argv[])
+{
+	if (argc < 2 || argc > 3) {
+		fprintf (stderr, "usage: %s <trace.pitrace> [out.plotme]\n", argv[0]);
+		return 1;
+	}
+
+	ifstream in (argv[1], ios::in | ios::binary);
+	uint32_t maxBlock;
+	if (!in || !PiTraceWriter::ReadHeader (in, maxBlock)) {
+		fprintf (stderr, "%s: not a PI binary trace\n", argv[1]);
+		return 1;
+	}
+
+	ofstream file;
+	if (argc == 3) {
+		file.open (argv[2], ios::out | ios::trunc);
+		if (!file) {
+			perror (argv[2]);
+			return 1;
+		}
+	}
+	ostream &out = (argc == 3) ? file : cout;
+
+	// Блоки читаются по одному, так что память не зависит от длины трассы
+	vector<PiTraceWriter::Sample> block;
+	uint64_t samples = 0;
+	while (PiTraceWriter::ReadBlock (in, block, maxBlock)) {
+		PiTraceWriter::WriteText (out, block);
+		samples += block.size ();
+	}
+	if (in.bad () || !in.eof ()) {
+		fprintf (stderr, "%s: truncated or corrupt block after %llu samples\n", argv[1], (unsigned long long) samples);
+		return 1;
+	}
+	out.flush ();
+	return out.good () ? 0 : 1;
+}
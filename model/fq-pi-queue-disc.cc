@@ -0,0 +1,504 @@
+
+#include "ns3/log.h"
+#include "ns3/uinteger.h"
+#include "ns3/double.h"
+#include "ns3/boolean.h"
+#include "ns3/enum.h"
+#include "ns3/simulator.h"
+#include "ns3/drop-tail-queue.h"
+#include "fq-pi-queue-disc.h"
+#include "ns3/packet-filter.h"
+
+#include <algorithm>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("FqPiQueueDisc");
+
+NS_OBJECT_ENSURE_REGISTERED (FqPiQueueDisc);
+
+TypeId FqPiQueueDisc::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::FqPiQueueDisc")
+    .SetParent<QueueDisc> ()
+    .SetGroupName ("TrafficControl")
+    .AddConstructor<FqPiQueueDisc> ()
+    .AddAttribute ("Flows",
+                   "Number of flow buckets",
+                   UintegerValue (1024),
+                   MakeUintegerAccessor (&FqPiQueueDisc::m_nFlows),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("Quantum",
+                   "DRR quantum in bytes",
+                   UintegerValue (1500),
+                   MakeUintegerAccessor (&FqPiQueueDisc::m_quantum),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("Perturbation",
+                   "The salt used as an additional input to the hash function used to classify packets",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&FqPiQueueDisc::m_perturbation),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("DropBatchSize",
+                   "Most packets dropped from the longest bucket when the queue disc is full",
+                   UintegerValue (64),
+                   MakeUintegerAccessor (&FqPiQueueDisc::m_dropBatchSize),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("QueueRef",
+                   "Desired queue size of each bucket, in packets",
+                   DoubleValue (10),
+                   MakeDoubleAccessor (&FqPiQueueDisc::m_qRef),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("A",
+                   "Value of alpha",
+                   DoubleValue (0.00001822),
+                   MakeDoubleAccessor (&FqPiQueueDisc::m_a),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("B",
+                   "Value of beta",
+                   DoubleValue (0.00001816),
+                   MakeDoubleAccessor (&FqPiQueueDisc::m_b),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("W",
+                   "Sampling frequency",
+                   DoubleValue (170),
+                   MakeDoubleAccessor (&FqPiQueueDisc::m_w),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("UseEcn",
+                   "True to use ECN (ECN-capable packets are marked instead of being dropped early)",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&FqPiQueueDisc::m_useEcn),
+                   MakeBooleanChecker ())
+    .AddAttribute ("MarkEcnThreshold",
+                   "Drop probability above which ECN-capable packets are dropped instead of marked",
+                   DoubleValue (0.1),
+                   MakeDoubleAccessor (&FqPiQueueDisc::m_markEcnTh),
+                   MakeDoubleChecker<double> (0, 1))
+    .AddAttribute ("GeometricDrop",
+                   "Draw the number of packets until the next early drop of a bucket "
+                   "from a geometric distribution, instead of one random value per packet",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&FqPiQueueDisc::m_geometricDrop),
+                   MakeBooleanChecker ())
+    .AddAttribute ("AntiWindup",
+                   "Anti-windup of the integral term of each bucket, as in PiQueueDisc",
+                   EnumValue (static_cast<int> (PiAntiWindup::NONE)),
+                   MakeEnumAccessor (&FqPiQueueDisc::m_antiWindup),
+                   MakeEnumChecker (static_cast<int> (PiAntiWindup::NONE), "None",
+                                    static_cast<int> (PiAntiWindup::CONDITIONAL), "Conditional",
+                                    static_cast<int> (PiAntiWindup::BACK_CALCULATION), "BackCalculation"))
+    .AddAttribute ("AntiWindupGain",
+                   "Share of the clamped-off output removed from the integral at each update with BackCalculation",
+                   DoubleValue (0.5),
+                   MakeDoubleAccessor (&FqPiQueueDisc::m_antiWindupGain),
+                   MakeDoubleChecker<double> (0, 1))
+    .AddAttribute ("MaxBurstAllowance",
+                   "As in PIE: time during which a bucket does not drop early after it has been idle "
+                   "(p = 0 and below half of QueueRef at two updates); zero disables",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&FqPiQueueDisc::m_maxBurst),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxSize",
+                   "The maximum number of packets accepted by this queue disc",
+                   QueueSizeValue (QueueSize ("10240p")),
+                   MakeQueueSizeAccessor (&QueueDisc::SetMaxSize,
+                                          &QueueDisc::GetMaxSize),
+                   MakeQueueSizeChecker ())
+  ;
+
+  return tid;
+}
+
+FqPiQueueDisc::FqPiQueueDisc ()
+  : QueueDisc ()
+{
+//  NS_LOG_FUNCTION (this);
+  m_uv = CreateObject<UniformRandomVariable> ();
+}
+
+FqPiQueueDisc::~FqPiQueueDisc ()
+{
+//  NS_LOG_FUNCTION (this);
+}
+
+void
+FqPiQueueDisc::DoDispose (void)
+{
+//  NS_LOG_FUNCTION (this);
+  m_uv = 0;
+  m_queueFlow.clear ();
+  m_flows.clear ();
+  m_controllers.clear ();
+  QueueDisc::DoDispose ();
+}
+
+uint32_t
+FqPiQueueDisc::GetQueueSize (void)
+{
+//  NS_LOG_FUNCTION (this);
+  return GetNPackets ();
+}
+
+double
+FqPiQueueDisc::GetDropProbability (uint32_t bucket) const
+{
+//  NS_LOG_FUNCTION (this << bucket);
+  NS_ASSERT (bucket < m_controllers.size ());
+  return m_controllers[bucket].GetDropProbability ();
+}
+
+FqPiQueueDisc::Stats
+FqPiQueueDisc::GetStats ()
+{
+//  NS_LOG_FUNCTION (this);
+  return m_stats;
+}
+
+int64_t
+FqPiQueueDisc::AssignStreams (int64_t stream)
+{
+//  NS_LOG_FUNCTION (this << stream);
+  m_uv->SetStream (stream);
+  return 1;
+}
+
+bool
+FqPiQueueDisc::GetBucket (Ptr<QueueDiscItem> item, uint32_t &bucket)
+{
+  if (GetNPacketFilters () == 0)
+    {
+      bucket = item->Hash (m_perturbation) % m_nFlows;
+      return true;
+    }
+
+  int32_t ret = QueueDisc::Classify (item);
+  if (ret == PacketFilter::PF_NO_MATCH)
+    {
+      return false;
+    }
+  bucket = static_cast<uint32_t> (ret) % m_nFlows;
+  return true;
+}
+
+uint32_t
+FqPiQueueDisc::GetLength (uint32_t index) const
+{
+  uint32_t queue = m_flows[index].queue;
+  return queue == NONE ? 0 : GetInternalQueue (queue)->GetNPackets ();
+}
+
+Ptr<QueueDisc::InternalQueue>
+FqPiQueueDisc::GetFlowQueue (uint32_t index)
+{
+  Flow &flow = m_flows[index];
+  if (flow.queue == NONE)
+    {
+      // As in FQ-CoDel, created for the first packet of the bucket; the
+      // queue disc enforces MaxSize, so the queue itself never overflows
+      Ptr<InternalQueue> queue = CreateObject<DropTailQueue<QueueDiscItem> > ();
+      queue->SetMaxSize (GetMaxSize ());
+      AddInternalQueue (queue);
+      flow.queue = m_queueFlow.size ();
+      m_queueFlow.push_back (index);
+    }
+  return GetInternalQueue (flow.queue);
+}
+
+void
+FqPiQueueDisc::DropFromLongest (void)
+{
+  // Only buckets that have had traffic have a queue
+  uint32_t longest = NONE;
+  uint32_t longestLength = 0;
+  for (uint32_t q = 0; q < m_queueFlow.size (); q++)
+    {
+      uint32_t length = GetInternalQueue (q)->GetNPackets ();
+      if (length > longestLength)
+        {
+          longest = q;
+          longestLength = length;
+        }
+    }
+  if (longest == NONE)
+    {
+      return;
+    }
+
+  // The bucket keeps its place in the scheduler: if it empties, the next
+  // dequeue finds it so and removes it from its list. Dequeuing from the
+  // internal queue keeps the counts of the base class right, as in FQ-CoDel
+  Ptr<InternalQueue> queue = GetInternalQueue (longest);
+  uint32_t batch = std::min (m_dropBatchSize, (longestLength + 1) / 2);
+  for (uint32_t i = 0; i < batch; i++)
+    {
+      DropAfterDequeue (queue->Dequeue (), "Overlimit drop");
+      m_stats.forcedDrop++;
+    }
+  NS_LOG_LOGIC ("\t Dropped " << batch << " packets from bucket " << m_queueFlow[longest]);
+}
+
+void
+FqPiQueueDisc::PushBack (FlowList &list, uint32_t index)
+{
+  m_flows[index].next = NONE;
+  if (list.tail == NONE)
+    {
+      list.head = index;
+    }
+  else
+    {
+      m_flows[list.tail].next = index;
+    }
+  list.tail = index;
+}
+
+uint32_t
+FqPiQueueDisc::PopFront (FlowList &list)
+{
+  uint32_t index = list.head;
+  list.head = m_flows[index].next;
+  if (list.head == NONE)
+    {
+      list.tail = NONE;
+    }
+  return index;
+}
+
+void
+FqPiQueueDisc::UpdateP (uint32_t index)
+{
+  Flow &flow = m_flows[index];
+  int64_t now = Simulator::Now ().GetTimeStep ();
+  if (now < flow.nextUpdate)
+    {
+      return;
+    }
+
+  uint64_t intervals = 1 + (now - flow.nextUpdate) / m_period;
+  flow.nextUpdate += m_period * intervals;
+
+  Controller &ctl = m_controllers[index];
+  uint32_t length = GetLength (index);
+  double err = ctl.GetLengthError (length);
+  bool changed = ctl.Update (err, intervals);
+  if (m_geometricDrop && changed)
+    {
+      auto uniform = [this] () { return m_uv->GetValue (); };
+      ctl.DrawSkipCount (uniform);
+    }
+
+  if (!m_maxBurst.IsZero ())
+    {
+      // As in PiQueueDisc: an idle bucket earns the whole allowance again
+      if (ctl.GetDropProbability () == 0 && 2 * length < m_qRef && 2 * flow.qOld < m_qRef)
+        {
+          flow.burstEnd = now + m_maxBurst.GetTimeStep ();
+        }
+      flow.inBurst = now < flow.burstEnd;
+    }
+  flow.qOld = length;
+}
+
+bool
+FqPiQueueDisc::DropEarly (uint32_t index, Ptr<QueueDiscItem> item)
+{
+  Controller &ctl = m_controllers[index];
+  auto uniform = [this] () { return m_uv->GetValue (); };
+
+  if (m_geometricDrop)
+    {
+      if (ctl.SkipEarly (item->GetSize ()))
+        {
+          return false;
+        }
+      ctl.DrawSkipCount (uniform);
+      return true;
+    }
+
+  // Idle buckets draw no random number
+  return ctl.GetDropProbability () > 0 && ctl.DropEarly (item->GetSize (), uniform);
+}
+
+bool
+FqPiQueueDisc::DoEnqueue (Ptr<QueueDiscItem> item)
+{
+//  NS_LOG_FUNCTION (this << item);
+
+  uint32_t index;
+  if (!GetBucket (item, index))
+    {
+      NS_LOG_ERROR ("No filter has been able to classify this packet, drop it.");
+      DropBeforeEnqueue (item, "Forced drop");
+      m_stats.forcedDrop++;
+      return false;
+    }
+
+  UpdateP (index);
+  Flow &flow = m_flows[index];
+
+  if (!flow.inBurst && DropEarly (index, item))
+    {
+      if (m_useEcn && m_controllers[index].GetDropProbability () <= m_markEcnTh && Mark (item, "Unforced mark"))
+        {
+          // Early probability mark: the ECN-capable packet is enqueued
+          m_stats.unforcedMark++;
+        }
+      else
+        {
+          // Early probability drop, decided by the bucket's own controller
+          DropBeforeEnqueue (item, "Unforced drop");
+          m_stats.unforcedDrop++;
+          return false;
+        }
+    }
+
+  if (GetNPackets () >= GetMaxSize ().GetValue ())
+    {
+      // Drops due to queue limit: reactive, and charged to the longest
+      // bucket rather than to the flow of the arriving packet
+      DropFromLongest ();
+    }
+
+  bool retval = GetFlowQueue (index)->Enqueue (item);
+
+  if (flow.status == INACTIVE)
+    {
+      flow.status = NEW_FLOW;
+      flow.deficit = m_quantum;
+      PushBack (m_newFlows, index);
+    }
+
+  NS_LOG_LOGIC ("\t Bucket " << index << " length " << GetLength (index));
+  return retval;
+}
+
+Ptr<QueueDiscItem>
+FqPiQueueDisc::DoDequeue (void)
+{
+//  NS_LOG_FUNCTION (this);
+
+  Ptr<QueueDiscItem> item;
+  uint32_t index;
+
+  do
+    {
+      bool fromNew = m_newFlows.head != NONE;
+      if (!fromNew && m_oldFlows.head == NONE)
+        {
+          NS_LOG_LOGIC ("No flow found to dequeue a packet");
+          return 0;
+        }
+
+      FlowList &list = fromNew ? m_newFlows : m_oldFlows;
+      index = list.head;
+      Flow &flow = m_flows[index];
+
+      if (flow.deficit <= 0)
+        {
+          // Quantum used up: go to the back of the old flows
+          flow.deficit += m_quantum;
+          PopFront (list);
+          flow.status = OLD_FLOW;
+          PushBack (m_oldFlows, index);
+          continue;
+        }
+
+      UpdateP (index);
+      if (flow.queue != NONE)
+        {
+          item = GetInternalQueue (flow.queue)->Dequeue ();
+        }
+
+      if (!item)
+        {
+          PopFront (list);
+          if (fromNew && m_oldFlows.head != NONE)
+            {
+              // As in FQ-CoDel, an emptied new flow goes through the old list
+              // once, so it cannot regain priority by going idle briefly
+              flow.status = OLD_FLOW;
+              PushBack (m_oldFlows, index);
+            }
+          else
+            {
+              flow.status = INACTIVE;
+            }
+        }
+    }
+  while (!item);
+
+  m_flows[index].deficit -= item->GetSize ();
+  return item;
+}
+
+bool
+FqPiQueueDisc::CheckConfig (void)
+{
+  NS_LOG_FUNCTION (this);
+  if (GetNQueueDiscClasses () > 0)
+    {
+      NS_LOG_ERROR ("FqPiQueueDisc cannot have classes");
+      return false;
+    }
+
+  if (GetMaxSize ().GetUnit () != QueueSizeUnit::PACKETS)
+    {
+      NS_LOG_ERROR ("FqPiQueueDisc limits its size in packets");
+      return false;
+    }
+
+  if (GetNInternalQueues () > 0)
+    {
+      NS_LOG_ERROR ("FqPiQueueDisc creates the internal queues of its buckets itself");
+      return false;
+    }
+
+  if (GetMaxSize ().GetValue () == 0)
+    {
+      NS_LOG_ERROR ("FqPiQueueDisc needs room for at least one packet");
+      return false;
+    }
+
+  if (m_w <= 0)
+    {
+      NS_LOG_ERROR ("The sampling frequency must be positive");
+      return false;
+    }
+
+  return true;
+}
+
+void
+FqPiQueueDisc::InitializeParams (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_stats.unforcedDrop = 0;
+  m_stats.forcedDrop = 0;
+  m_stats.unforcedMark = 0;
+
+  m_period = Seconds (1.0 / m_w).GetTimeStep ();
+  int64_t first = (Simulator::Now () + Seconds (1.0 / m_w)).GetTimeStep ();
+
+  Flow idle;
+  idle.nextUpdate = first;
+  idle.burstEnd = (Simulator::Now () + m_maxBurst).GetTimeStep ();
+  idle.inBurst = m_maxBurst.IsStrictlyPositive ();
+  idle.deficit = 0;
+  idle.qOld = 0;
+  idle.next = NONE;
+  idle.queue = NONE;
+  idle.status = INACTIVE;
+  m_flows.assign (m_nFlows, idle);
+
+  Controller ctl;
+  ctl.SetGains (m_a, m_b);
+  ctl.SetQueueRef (m_qRef);
+  ctl.SetAntiWindup (m_antiWindup, m_antiWindupGain);
+  ctl.Reset ();
+  m_controllers.assign (m_nFlows, ctl);
+  m_queueFlow.clear ();
+
+  m_newFlows.head = m_newFlows.tail = NONE;
+  m_oldFlows.head = m_oldFlows.tail = NONE;
+}
+
+} //namespace ns3
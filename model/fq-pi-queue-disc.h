@@ -0,0 +1,244 @@
+#ifndef FQ_PI_QUEUE_DISC_H
+#define FQ_PI_QUEUE_DISC_H
+
+#include <vector>
+#include "ns3/queue-disc.h"
+#include "ns3/nstime.h"
+#include "ns3/random-variable-stream.h"
+#include "pi-controller.h"
+
+namespace ns3 {
+
+class UniformRandomVariable;
+
+/**
+ * \ingroup traffic-control
+ *
+ * \brief Flow queuing with a PI controller per flow bucket
+ *
+ * Packets are hashed into a fixed number of buckets, each with its own FIFO
+ * and its own PI drop probability. Buckets are served by deficit round
+ * robin with the new/old flow lists of FQ-CoDel, so a flow that sends
+ * faster than its fair share only builds up its own bucket, and only its
+ * own controller raises the drop probability. The controllers are the
+ * PiController of PiQueueDisc, with its ECN marking, geometric drops,
+ * anti-windup and burst allowance. When the whole queue disc
+ * is full, packets are dropped from the head of the longest bucket, as in
+ * FQ-CoDel, so an unresponsive flow cannot push the others into forced
+ * drops.
+ *
+ * The flow table and the controllers are allocated once, at
+ * initialization: a bucket costs a 40-byte table entry and an 88-byte
+ * controller, and a lookup is a hash and an array index. As in FQ-CoDel,
+ * the packets of a bucket are kept in an internal DropTailQueue created
+ * when the bucket gets its first packet, so buckets that never see
+ * traffic cost no queue, and the QueueDisc base class keeps its packet
+ * and byte counts and its traces. Controllers are updated lazily, when
+ * their bucket is touched, by replaying the sampling intervals elapsed
+ * since the last update, so idle buckets cost no events.
+ */
+class FqPiQueueDisc : public QueueDisc
+{
+public:
+  /**
+   * \brief Get the type ID.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+
+  /**
+   * \brief FqPiQueueDisc Constructor
+   */
+  FqPiQueueDisc ();
+
+  /**
+   * \brief FqPiQueueDisc Destructor
+   */
+  virtual ~FqPiQueueDisc ();
+
+  /**
+   * \brief Stats
+   */
+  typedef struct
+  {
+    uint64_t unforcedDrop;      //!< Early probability drops: proactive
+    uint64_t forcedDrop;        //!< Drops due to queue limit: reactive
+    uint64_t unforcedMark;      //!< Early probability marks: proactive
+  } Stats;
+
+  /**
+   * \brief Get the number of packets queued in all buckets.
+   *
+   * \returns The queue size in packets.
+   */
+  uint32_t GetQueueSize (void);
+
+  /**
+   * \brief Get the drop probability of the bucket a flow hash maps to.
+   *
+   * \param bucket bucket index, less than the Flows attribute
+   * \returns The drop probability as of the last update of the bucket.
+   */
+  double GetDropProbability (uint32_t bucket) const;
+
+  /**
+   * \brief Get FQ-PI statistics after running.
+   *
+   * \returns The drop statistics.
+   */
+  Stats GetStats ();
+
+  /**
+   * Assign a fixed random variable stream number to the random variables
+   * used by this model.  Return the number of streams (possibly zero) that
+   * have been assigned.
+   *
+   * \param stream first stream index to use
+   * \return the number of stream indices assigned by this model
+   */
+  int64_t AssignStreams (int64_t stream);
+
+protected:
+  /**
+   * \brief Dispose of the object
+   */
+  virtual void DoDispose (void);
+
+private:
+  virtual bool DoEnqueue (Ptr<QueueDiscItem> item);
+  virtual Ptr<QueueDiscItem> DoDequeue (void);
+  virtual bool CheckConfig (void);
+  virtual void InitializeParams (void);
+
+  /// Position of a bucket in the scheduler
+  enum FlowStatus : uint8_t
+  {
+    INACTIVE,
+    NEW_FLOW,
+    OLD_FLOW
+  };
+
+  /**
+   * \brief Per-bucket scheduler and PI controller state
+   *
+   * Kept small and in one contiguous table; the packets themselves are in
+   * the internal queue of the bucket.
+   */
+  struct Flow
+  {
+    int64_t nextUpdate;         //!< Next sampling instant, in time steps
+    int64_t burstEnd;           //!< End of the burst allowance, in time steps
+    int32_t deficit;            //!< DRR deficit in bytes
+    uint32_t qOld;              //!< Queue length at the previous sample
+    uint32_t next;              //!< Next bucket in the new or old list
+    uint32_t queue;             //!< Index of the internal queue of the bucket, or NONE before its first packet
+    FlowStatus status;          //!< List the bucket is in
+    bool inBurst;               //!< True while the burst allowance is not used up
+  };
+
+  /// PI controller of a bucket
+  typedef PiController<PiUnit::PACKETS> Controller;
+
+  /// Intrusive singly-linked list of buckets
+  struct FlowList
+  {
+    uint32_t head;              //!< First bucket, or NONE
+    uint32_t tail;              //!< Last bucket, or NONE
+  };
+
+  static const uint32_t NONE = 0xffffffff;  //!< End of a flow list, or no internal queue
+
+  /**
+   * \brief Map an item to its bucket
+   * \param item the item
+   * \param bucket the bucket index, if the item could be classified
+   * \returns false if a packet filter did not match the item
+   */
+  bool GetBucket (Ptr<QueueDiscItem> item, uint32_t &bucket);
+
+  /**
+   * \brief Bring the drop probability of a bucket up to date
+   *
+   * All sampling intervals since the last update saw the current length of
+   * the bucket, so they are applied in closed form by the controller.
+   *
+   * \param index bucket index
+   */
+  void UpdateP (uint32_t index);
+
+  /**
+   * \brief Check if a packet needs to be dropped due to probability drop
+   * \param index bucket index
+   * \param item queue item
+   * \returns true for drop
+   */
+  bool DropEarly (uint32_t index, Ptr<QueueDiscItem> item);
+
+  /**
+   * \brief Get the number of packets in a bucket
+   * \param index bucket index
+   * \returns the length of the internal queue of the bucket, 0 if it has none
+   */
+  uint32_t GetLength (uint32_t index) const;
+
+  /**
+   * \brief Get the internal queue of a bucket, creating it on first use
+   * \param index bucket index
+   * \returns the internal queue
+   */
+  Ptr<InternalQueue> GetFlowQueue (uint32_t index);
+
+  /**
+   * \brief Make room by dropping from the head of the longest bucket
+   *
+   * As in FQ-CoDel, up to half of the bucket, at most DropBatchSize
+   * packets, goes at once, so that the scan over the buckets is paid once
+   * per batch rather than once per packet.
+   */
+  void DropFromLongest (void);
+
+  /**
+   * \brief Append a bucket to a list
+   * \param list the list
+   * \param index bucket index
+   */
+  void PushBack (FlowList &list, uint32_t index);
+
+  /**
+   * \brief Remove the first bucket of a list
+   * \param list the list, not empty
+   * \returns the index of the removed bucket
+   */
+  uint32_t PopFront (FlowList &list);
+
+  Stats m_stats;                                //!< FQ-PI statistics
+
+  // ** Variables supplied by user
+  uint32_t m_nFlows;                            //!< Number of flow buckets
+  uint32_t m_quantum;                           //!< DRR quantum in bytes
+  uint32_t m_perturbation;                      //!< Hash perturbation value
+  uint32_t m_dropBatchSize;                     //!< Most packets dropped from the longest bucket at once
+  double m_qRef;                                //!< Desired queue size of each bucket, in packets
+  double m_a;                                   //!< Parameter to pi controller
+  double m_b;                                   //!< Parameter to pi controller
+  double m_w;                                   //!< Sampling frequency (Number of times per second)
+  bool m_useEcn;                                //!< True if ECN is used (packets are marked instead of being dropped)
+  double m_markEcnTh;                           //!< ECN marking threshold (probability above which packets are dropped)
+  bool m_geometricDrop;                         //!< Draw the distance to the next early drop instead of testing every packet
+  PiAntiWindup m_antiWindup;                    //!< Anti-windup of the integral term
+  double m_antiWindupGain;                      //!< Back-calculation share of the clamped-off output
+  Time m_maxBurst;                              //!< Burst allowance after an idle period, zero for none
+
+  // ** Variables maintained by FQ-PI
+  std::vector<Flow> m_flows;                    //!< Flow table, one entry per bucket
+  std::vector<Controller> m_controllers;        //!< PI controller of each bucket
+  std::vector<uint32_t> m_queueFlow;            //!< Bucket of each internal queue
+  FlowList m_newFlows;                          //!< Buckets that became active recently
+  FlowList m_oldFlows;                          //!< Buckets that already used a quantum
+  int64_t m_period;                             //!< Sampling period, in time steps
+  Ptr<UniformRandomVariable> m_uv;              //!< Rng stream
+};
+
+};   // namespace ns3
+
+#endif
@@ -0,0 +1,344 @@
+#ifndef PI_CONTROLLER_H
+#define PI_CONTROLLER_H
+
+#include <cmath>
+#include <limits>
+#include <stdint.h>
+
+namespace ns3 {
+
+/// Unit the queue length is measured in
+enum class PiUnit
+{
+  PACKETS,
+  BYTES
+};
+
+/// Anti-windup of the integral term
+enum class PiAntiWindup
+{
+  NONE,             //!< Incremental form, p clamped to [0, 1] after each update
+  CONDITIONAL,      //!< Stop integrating while p is saturated and the error pushes it further
+  BACK_CALCULATION  //!< Pull the integral back by the part of the output the clamp cut off
+};
+
+/**
+ * \ingroup traffic-control
+ *
+ * \brief Control law and drop decision of the PI AQM
+ *
+ * Only arithmetic: no simulator, packet or random variable types, so the
+ * controller can be built and measured on its own. The caller supplies
+ * the queue length, the number of sampling intervals and, for the drop
+ * decision, a callable returning uniform numbers in [0, 1).
+ *
+ * The error fed to the controller is always in packets of the mean size,
+ * so the gains A and B are the same in both units.
+ *
+ * \tparam Unit unit of the queue length
+ * \tparam Real floating point type of the controller state
+ */
+template <PiUnit Unit, typename Real = double>
+class PiController
+{
+public:
+  PiController ()
+    : m_a (0),
+      m_b (0),
+      m_qRef (0),
+      m_invMeanPktSize (1),
+      m_antiWindup (PiAntiWindup::NONE),
+      m_trackingGain (1)
+  {
+    Reset ();
+  }
+
+  /**
+   * \brief Set the gains
+   * \param a gain applied to the current error
+   * \param b gain applied to the previous error
+   */
+  void SetGains (Real a, Real b)
+  {
+    m_a = a;
+    m_b = b;
+  }
+
+  /**
+   * \brief Set the anti-windup of the integral term
+   *
+   * Other than NONE, the controller keeps its integral separately:
+   * p = B e + I, and every interval adds (A - B) e to I, the same law
+   * as the incremental form while p stays within [0, 1].
+   *
+   * \param mode anti-windup
+   * \param trackingGain share of the clamped-off output removed from the
+   *        integral at each interval in BACK_CALCULATION mode, in (0, 1]
+   */
+  void SetAntiWindup (PiAntiWindup mode, Real trackingGain)
+  {
+    m_antiWindup = mode;
+    m_trackingGain = trackingGain;
+  }
+
+  /**
+   * \brief Set the desired queue length
+   * \param qRef desired queue length, in packets of the mean size
+   */
+  void SetQueueRef (Real qRef)
+  {
+    m_qRef = qRef;
+  }
+
+  /**
+   * \brief Set the mean packet size, used to convert bytes to packets
+   * \param size mean packet size in bytes, positive
+   */
+  void SetMeanPktSize (uint32_t size)
+  {
+    m_invMeanPktSize = Real (1) / size;
+  }
+
+  /**
+   * \brief Forget the drop probability and the previous error
+   *
+   * The previous error is that of an empty queue.
+   */
+  void Reset (void)
+  {
+    m_p = 0;
+    m_integral = 0;
+    m_errOld = -m_qRef;
+    m_count = std::numeric_limits<Real>::infinity ();
+    m_countBytes = std::numeric_limits<uint64_t>::max ();
+  }
+
+  /**
+   * \returns The drop probability.
+   */
+  Real GetDropProbability (void) const
+  {
+    return m_p;
+  }
+
+  /**
+   * \brief Get the error of a queue length with respect to the reference
+   * \param qlen queue length in the unit of the controller
+   * \returns The error in packets.
+   */
+  Real GetLengthError (uint64_t qlen) const
+  {
+    Real q = qlen;
+    if (Unit == PiUnit::BYTES)
+      {
+        q = q * m_invMeanPktSize;
+      }
+    return q - m_qRef;
+  }
+
+  /**
+   * \brief Get the error of a queue delay with respect to a reference
+   *
+   * The delay is estimated from the backlog and the departure rate, and
+   * its error scaled back to packets by that rate.
+   *
+   * \param bytes backlog in bytes
+   * \param rate departure rate in bytes/s, positive
+   * \param delayRef desired delay in seconds
+   * \returns The error in packets.
+   */
+  Real GetDelayError (uint64_t bytes, Real rate, Real delayRef) const
+  {
+    Real qDelay = bytes / rate;
+    return (qDelay - delayRef) * rate * m_invMeanPktSize;
+  }
+
+  /**
+   * \brief Apply the control law for a number of sampling intervals
+   *
+   * All intervals see the same error: after the first one the probability
+   * moves by the same step each time. Clamping a monotone sequence at
+   * every step is the same as clamping once at the end.
+   *
+   * \param err error in packets, from GetLengthError or GetDelayError
+   * \param intervals number of consecutive intervals, at least 1
+   * \returns True if the drop probability changed.
+   */
+  bool Update (Real err, uint64_t intervals)
+  {
+    if (m_antiWindup != PiAntiWindup::NONE)
+      {
+        return UpdateIntegral (err, intervals);
+      }
+
+    Real p = m_a * err - m_b * m_errOld + m_p;
+    p = (p < 0) ? 0 : p;
+    p = (p > 1) ? 1 : p;
+
+    if (intervals > 1)
+      {
+        p += (intervals - 1) * (m_a - m_b) * err;
+        p = (p < 0) ? 0 : p;
+        p = (p > 1) ? 1 : p;
+      }
+
+    bool changed = p != m_p;
+    m_p = p;
+    m_errOld = err;
+    return changed;
+  }
+
+  /**
+   * \brief Decide whether to drop a packet, with one random number
+   *
+   * In byte mode the probability is scaled by the size of the packet
+   * relative to the mean size.
+   *
+   * \param size packet size in bytes
+   * \param uniform callable returning a uniform number in [0, 1)
+   * \returns True if the packet is to be dropped.
+   */
+  template <typename Uniform>
+  bool DropEarly (uint32_t size, Uniform &uniform) const
+  {
+    Real p = m_p;
+    if (Unit == PiUnit::BYTES)
+      {
+        p = p * size * m_invMeanPktSize;
+      }
+    p = p > 1 ? 1 : p;
+    return !(uniform () > p);
+  }
+
+  /**
+   * \brief Let a packet through if the skip count allows it
+   *
+   * Geometric mode: the number of packets (or bytes) before the next drop
+   * is drawn by DrawSkipCount, so no random number is needed per packet.
+   *
+   * \param size packet size in bytes
+   * \returns False if the packet is to be dropped; DrawSkipCount must then
+   *          be called before the next packet.
+   */
+  bool SkipEarly (uint32_t size)
+  {
+    if (Unit == PiUnit::BYTES)
+      {
+        if (m_countBytes >= size)
+          {
+            m_countBytes -= size;
+            return true;
+          }
+        return false;
+      }
+    if (m_count >= 1)
+      {
+        m_count -= 1;
+        return true;
+      }
+    return false;
+  }
+
+  /**
+   * \brief Draw the distance to the next drop
+   *
+   * Each packet is dropped with probability p, independently of the
+   * others: the number let through before the next drop is geometric,
+   * floor (ln U / ln (1 - p)) with U uniform in (0, 1]. In byte mode every
+   * byte is dropped with the probability that makes a packet of the mean
+   * size dropped with probability p. No random number is used if p is 0.
+   *
+   * \param uniform callable returning a uniform number in [0, 1)
+   */
+  template <typename Uniform>
+  void DrawSkipCount (Uniform &uniform)
+  {
+    if (m_p <= 0)
+      {
+        m_count = std::numeric_limits<Real>::infinity ();
+        m_countBytes = std::numeric_limits<uint64_t>::max ();
+        return;
+      }
+
+    Real logKeep = std::log1p (-m_p);
+    if (Unit == PiUnit::BYTES)
+      {
+        logKeep = logKeep * m_invMeanPktSize;
+      }
+    Real skip = std::floor (std::log (1 - uniform ()) / logKeep);
+    if (Unit == PiUnit::BYTES)
+      {
+        m_countBytes = skip < std::numeric_limits<uint64_t>::max ()
+          ? static_cast<uint64_t> (skip) : std::numeric_limits<uint64_t>::max ();
+      }
+    else
+      {
+        m_count = skip;
+      }
+  }
+
+private:
+  /**
+   * \brief Apply the control law with anti-windup
+   *
+   * The integral moves freely for as many intervals as the output starts
+   * within [0, 1], found in closed form; the remaining intervals are
+   * either skipped (CONDITIONAL) or replayed until the integral settles
+   * (BACK_CALCULATION).
+   *
+   * \param err error in packets
+   * \param intervals number of consecutive intervals, at least 1
+   * \returns True if the drop probability changed.
+   */
+  bool UpdateIntegral (Real err, uint64_t intervals)
+  {
+    Real proportional = m_b * err;
+    Real step = (m_a - m_b) * err;
+    if (step != 0)
+      {
+        // Intervals that start with the output short of the bound it moves
+        // to: the last of them may cross it, and the clamp then holds p there
+        Real bound = step > 0 ? 1 : 0;
+        Real room = (bound - proportional - m_integral) / step;
+        Real free = room < 0 ? 0 : std::floor (room) + 1;
+        uint64_t n = free >= intervals ? intervals : static_cast<uint64_t> (free);
+        m_integral += n * step;
+        for (n = intervals - n; n > 0 && m_antiWindup == PiAntiWindup::BACK_CALCULATION; n--)
+          {
+            Real out = proportional + m_integral + step;
+            Real clamped = (out < 0) ? 0 : (out > 1 ? 1 : out);
+            Real integral = m_integral + step + m_trackingGain * (clamped - out);
+            if (integral == m_integral)
+              {
+                break;
+              }
+            m_integral = integral;
+          }
+      }
+
+    Real p = proportional + m_integral;
+    p = (p < 0) ? 0 : p;
+    p = (p > 1) ? 1 : p;
+    bool changed = p != m_p;
+    m_p = p;
+    m_errOld = err;
+    return changed;
+  }
+
+private:
+  Real m_a;                                     //!< Gain applied to the current error
+  Real m_b;                                     //!< Gain applied to the previous error
+  Real m_qRef;                                  //!< Desired queue size, in packets
+  Real m_invMeanPktSize;                        //!< 1 / mean packet size
+  Real m_p;                                     //!< Drop probability
+  Real m_errOld;                                //!< Error at the previous sample, in packets
+  PiAntiWindup m_antiWindup;                    //!< Anti-windup of the integral term
+  Real m_trackingGain;                          //!< Back-calculation share of the clamped-off output
+  Real m_integral;                              //!< Integral term, unless m_antiWindup is NONE
+  Real m_count;                                 //!< Packets left before the next drop (geometric, packet mode)
+  uint64_t m_countBytes;                        //!< Bytes left before the next drop (geometric, byte mode)
+};
+
+};   // namespace ns3
+
+#endif
@@ -0,0 +1,118 @@
+
+#include <cmath>
+#include "pi-histogram.h"
+
+namespace ns3 {
+
+PiHistogram::PiHistogram ()
+{
+  Reset ();
+}
+
+void
+PiHistogram::Reset (void)
+{
+  m_counts.fill (0);
+  m_total = 0;
+  m_max = 0;
+}
+
+uint32_t
+PiHistogram::GetIndex (uint64_t value)
+{
+  const uint64_t linear = 1 << SUB_BITS;
+  if (value < linear)
+    {
+      return value;
+    }
+
+  // Keep the SUB_BITS most significant bits: the top one is always set,
+  // the others pick one of the 2^(SUB_BITS - 1) buckets of this power of two
+  uint32_t msb = 63 - __builtin_clzll (value);
+  uint32_t shift = msb - SUB_BITS + 1;
+  uint32_t sub = (value >> shift) - (linear >> 1);
+  return linear + (shift - 1) * (linear >> 1) + sub;
+}
+
+uint64_t
+PiHistogram::GetLowest (uint32_t index)
+{
+  const uint64_t linear = 1 << SUB_BITS;
+  if (index < linear)
+    {
+      return index;
+    }
+
+  uint32_t k = index - linear;
+  uint32_t shift = k / (linear >> 1) + 1;
+  uint64_t sub = k % (linear >> 1) + (linear >> 1);
+  return sub << shift;
+}
+
+uint64_t
+PiHistogram::GetHighest (uint32_t index)
+{
+  if (index + 1 == N_BUCKETS)
+    {
+      return UINT64_MAX;
+    }
+  return GetLowest (index + 1) - 1;
+}
+
+void
+PiHistogram::Add (uint64_t value)
+{
+  m_counts[GetIndex (value)]++;
+  m_total++;
+  m_max = (value > m_max) ? value : m_max;
+}
+
+uint64_t
+PiHistogram::GetCount (void) const
+{
+  return m_total;
+}
+
+uint64_t
+PiHistogram::GetPercentile (double percentile) const
+{
+  if (m_total == 0)
+    {
+      return 0;
+    }
+
+  // Rank of the sample, counting from 1
+  double rank = std::ceil (percentile / 100 * m_total);
+  uint64_t target = (rank < 1) ? 1 : static_cast<uint64_t> (rank);
+  target = (target > m_total) ? m_total : target;
+
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < N_BUCKETS; i++)
+    {
+      seen += m_counts[i];
+      if (seen >= target)
+        {
+          uint64_t highest = GetHighest (i);
+          return (highest < m_max) ? highest : m_max;
+        }
+    }
+  return m_max;
+}
+
+void
+PiHistogram::Print (std::ostream &os, double scale) const
+{
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < N_BUCKETS; i++)
+    {
+      if (m_counts[i] == 0)
+        {
+          continue;
+        }
+      seen += m_counts[i];
+      os << GetLowest (i) * scale << " " << GetHighest (i) * scale << " "
+         << m_counts[i] << " " << static_cast<double> (seen) / m_total << "\n";
+    }
+}
+
+} //namespace ns3
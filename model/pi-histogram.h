@@ -0,0 +1,100 @@
+#ifndef PI_HISTOGRAM_H
+#define PI_HISTOGRAM_H
+
+#include <array>
+#include <ostream>
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * \ingroup traffic-control
+ *
+ * \brief Log-bucketed histogram of non-negative integer samples
+ *
+ * Values below 2^SUB_BITS have a bucket each; above that, every power of
+ * two is split into 2^(SUB_BITS - 1) buckets of equal width, so a bucket
+ * is never wider than 1/2^(SUB_BITS - 1) of the values it holds, as in
+ * HdrHistogram. The whole 64-bit range fits in a fixed array: adding a
+ * sample is a bit scan and an increment, and never allocates.
+ */
+class PiHistogram
+{
+public:
+  static const uint32_t SUB_BITS = 6;           //!< Precision: 2^(SUB_BITS - 1) buckets per power of two
+  static const uint32_t N_BUCKETS = (1 << SUB_BITS) + (64 - SUB_BITS) * (1 << (SUB_BITS - 1));  //!< Number of buckets
+
+  /**
+   * \brief PiHistogram Constructor
+   */
+  PiHistogram ();
+
+  /**
+   * \brief Remove all samples
+   */
+  void Reset (void);
+
+  /**
+   * \brief Add a sample
+   * \param value the sample
+   */
+  void Add (uint64_t value);
+
+  /**
+   * \brief Get the number of samples
+   * \returns The number of samples added since the last reset.
+   */
+  uint64_t GetCount (void) const;
+
+  /**
+   * \brief Get a percentile of the samples
+   *
+   * The result is the highest value of the bucket the percentile falls in,
+   * but never more than the largest sample.
+   *
+   * \param percentile percentile in [0, 100]
+   * \returns The value, or 0 if there are no samples.
+   */
+  uint64_t GetPercentile (double percentile) const;
+
+  /**
+   * \brief Write the non-empty buckets, one per line
+   *
+   * Each line holds the bounds of the bucket multiplied by scale, the
+   * number of samples in it and the cumulative fraction of samples.
+   *
+   * \param os output stream
+   * \param scale factor applied to the bucket bounds
+   */
+  void Print (std::ostream &os, double scale) const;
+
+private:
+  /**
+   * \brief Get the bucket of a value
+   * \param value the value
+   * \returns The bucket index.
+   */
+  static uint32_t GetIndex (uint64_t value);
+
+  /**
+   * \brief Get the lowest value of a bucket
+   * \param index the bucket index
+   * \returns The lowest value that falls in the bucket.
+   */
+  static uint64_t GetLowest (uint32_t index);
+
+  /**
+   * \brief Get the highest value of a bucket
+   * \param index the bucket index
+   * \returns The highest value that falls in the bucket.
+   */
+  static uint64_t GetHighest (uint32_t index);
+
+  std::array<uint64_t, N_BUCKETS> m_counts;     //!< Samples in each bucket
+  uint64_t m_total;                             //!< Number of samples
+  uint64_t m_max;                               //!< Largest sample
+};
+
+};   // namespace ns3
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef PI_PROFILER_H
+#define PI_PROFILER_H
+
+/*
+ * Hot-path profiling of PiQueueDisc, compiled in only with -DPI_PROFILE
+ * (e.g. ./ns3 configure --cxxflags="-DPI_PROFILE"). Without it
+ * PI_PROFILE_SCOPE expands to nothing and PiQueueDisc has no profiler
+ * member, so a normal build is unchanged.
+ */
+
+#ifdef PI_PROFILE
+
+#include <chrono>
+#include <ostream>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace ns3 {
+
+/**
+ * \ingroup traffic-control
+ *
+ * \brief Call counts and time spent in the PI hot path
+ *
+ * Times are inclusive: an enqueue contains its DropEarly and, in lazy
+ * mode, its AdvanceP. On x86 the unit is the time stamp counter (cycles
+ * of the nominal frequency), elsewhere nanoseconds of steady_clock.
+ */
+class PiProfiler
+{
+public:
+  /// Profiled methods
+  enum Point
+  {
+    ENQUEUE,
+    DEQUEUE,
+    PEEK,
+    CALCULATE_P,
+    ADVANCE_P,
+    DROP_EARLY,
+    N_POINTS
+  };
+
+  PiProfiler ()
+  {
+    for (int i = 0; i < N_POINTS; i++)
+      {
+        m_calls[i] = 0;
+        m_ticks[i] = 0;
+      }
+  }
+
+  /**
+   * \brief Read the clock
+   * \returns the current time in ticks
+   */
+  static uint64_t Now (void)
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc ();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (
+      std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+#endif
+  }
+
+  /**
+   * \brief Account one call
+   * \param point profiled method
+   * \param ticks time it took
+   */
+  void Add (Point point, uint64_t ticks)
+  {
+    m_calls[point]++;
+    m_ticks[point] += ticks;
+  }
+
+  /**
+   * \brief Print one PI-PROFILE line per method that was called
+   * \param os output stream
+   * \param queue name of the queue on the lines
+   */
+  void Print (std::ostream &os, const void *queue) const
+  {
+    static const char *names[N_POINTS] = {"enqueue", "dequeue", "peek", "calculateP", "advanceP", "dropEarly"};
+#if defined(__x86_64__) || defined(__i386__)
+    const char *unit = "cycles";
+#else
+    const char *unit = "ns";
+#endif
+    for (int i = 0; i < N_POINTS; i++)
+      {
+        if (m_calls[i] == 0)
+          {
+            continue;
+          }
+        os << "PI-PROFILE queue=" << queue << " point=" << names[i] << " calls=" << m_calls[i]
+           << " " << unit << "=" << m_ticks[i] << " perCall=" << (double) m_ticks[i] / m_calls[i] << std::endl;
+      }
+  }
+
+private:
+  uint64_t m_calls[N_POINTS];   //!< Number of calls
+  uint64_t m_ticks[N_POINTS];   //!< Total time, in ticks of Now
+};
+
+/**
+ * \brief Times the enclosing scope into a PiProfiler
+ */
+class PiProfileScope
+{
+public:
+  PiProfileScope (PiProfiler &profiler, PiProfiler::Point point)
+    : m_profiler (profiler),
+      m_point (point),
+      m_start (PiProfiler::Now ())
+  {
+  }
+
+  ~PiProfileScope ()
+  {
+    m_profiler.Add (m_point, PiProfiler::Now () - m_start);
+  }
+
+private:
+  PiProfiler &m_profiler;       //!< Profiler the time goes to
+  PiProfiler::Point m_point;    //!< Profiled method
+  uint64_t m_start;             //!< Clock at the start of the scope
+};
+
+};   // namespace ns3
+
+#define PI_PROFILE_SCOPE(profiler, point) ns3::PiProfileScope piProfileScope (profiler, ns3::PiProfiler::point)
+
+#else
+
+#define PI_PROFILE_SCOPE(profiler, point)
+
+#endif
+
+#endif
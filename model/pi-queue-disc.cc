@@ -2,13 +2,23 @@
 #include "ns3/enum.h"
 #include "ns3/uinteger.h"
 #include "ns3/double.h"
+#include "ns3/boolean.h"
+#include "ns3/string.h"
 #include "ns3/simulator.h"
+#include "ns3/trace-source-accessor.h"
 #include "ns3/abort.h"
 #include "pi-queue-disc.h"
 #include "ns3/drop-tail-queue.h"
 
 #include "ns3/queue.h"
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#ifdef PI_PROFILE
+#include <iostream>
+#endif
+
 namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE ("PiQueueDisc");
@@ -52,6 +62,119 @@ TypeId PiQueueDisc::GetTypeId (void)
                    DoubleValue (170),
                    MakeDoubleAccessor (&PiQueueDisc::m_w),
                    MakeDoubleChecker<double> ())
+    .AddAttribute ("AntiWindup",
+                   "Anti-windup of the integral term: None keeps the incremental form clamped to [0, 1]; "
+                   "the others keep p = B e + I and stop (Conditional) or pull back (BackCalculation) "
+                   "the integral while p is saturated",
+                   EnumValue (static_cast<int> (PiAntiWindup::NONE)),
+                   MakeEnumAccessor (&PiQueueDisc::m_antiWindup),
+                   MakeEnumChecker (static_cast<int> (PiAntiWindup::NONE), "None",
+                                    static_cast<int> (PiAntiWindup::CONDITIONAL), "Conditional",
+                                    static_cast<int> (PiAntiWindup::BACK_CALCULATION), "BackCalculation"))
+    .AddAttribute ("AntiWindupGain",
+                   "Share of the clamped-off output removed from the integral at each update with BackCalculation",
+                   DoubleValue (0.5),
+                   MakeDoubleAccessor (&PiQueueDisc::m_antiWindupGain),
+                   MakeDoubleChecker<double> (0, 1))
+    .AddAttribute ("MaxBurstAllowance",
+                   "As in PIE: time during which early drops are off after the queue has been idle "
+                   "(p = 0 and below half of the reference at two updates); zero disables",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&PiQueueDisc::m_maxBurst),
+                   MakeTimeChecker ())
+    .AddAttribute ("DelayRef",
+                   "Desired queue delay; when positive it replaces QueueRef as the control target",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&PiQueueDisc::m_delayRef),
+                   MakeTimeChecker ())
+    .AddAttribute ("DequeueThreshold",
+                   "Minimum queue size in bytes before dequeue rate is measured",
+                   UintegerValue (16384),
+                   MakeUintegerAccessor (&PiQueueDisc::m_dqThreshold),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("LazyUpdate",
+                   "Update the drop probability on enqueue/dequeue instead of on a periodic timer",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&PiQueueDisc::m_lazyUpdate),
+                   MakeBooleanChecker ())
+    .AddAttribute ("AdaptiveSampling",
+                   "Sample faster while the error or its change is large and slower while the queue is settled "
+                   "or idle, between MinW and MaxW; A and B are rescaled to keep the same continuous controller",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&PiQueueDisc::m_adaptiveSampling),
+                   MakeBooleanChecker ())
+    .AddAttribute ("MinW",
+                   "Lowest sampling frequency in adaptive sampling mode",
+                   DoubleValue (42.5),
+                   MakeDoubleAccessor (&PiQueueDisc::m_minW),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("MaxW",
+                   "Highest sampling frequency in adaptive sampling mode",
+                   DoubleValue (680),
+                   MakeDoubleAccessor (&PiQueueDisc::m_maxW),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("AdaptiveThreshold",
+                   "Error, in packets, and change of the error per 1/W above which adaptive sampling speeds up; "
+                   "below half of it sampling slows down",
+                   DoubleValue (5),
+                   MakeDoubleAccessor (&PiQueueDisc::m_adaptiveTh),
+                   MakeDoubleChecker<double> (0))
+    .AddAttribute ("UseEcn",
+                   "True to use ECN (ECN-capable packets are marked instead of being dropped early)",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&PiQueueDisc::m_useEcn),
+                   MakeBooleanChecker ())
+    .AddAttribute ("MarkEcnThreshold",
+                   "Drop probability above which ECN-capable packets are dropped instead of marked",
+                   DoubleValue (0.1),
+                   MakeDoubleAccessor (&PiQueueDisc::m_markEcnTh),
+                   MakeDoubleChecker<double> (0, 1))
+    .AddAttribute ("GeometricDrop",
+                   "Draw the number of packets (bytes in byte mode) until the next early drop "
+                   "from a geometric distribution, instead of one random value per packet",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&PiQueueDisc::m_geometricDrop),
+                   MakeBooleanChecker ())
+    .AddAttribute ("AutoTune",
+                   "Recompute A and B from the measured capacity, number of flows and RTT",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&PiQueueDisc::m_autoTune),
+                   MakeBooleanChecker ())
+    .AddAttribute ("AutoTuneInterval",
+                   "Time between two recomputations of A and B",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&PiQueueDisc::m_tuneInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("BaseRtt",
+                   "Round-trip propagation delay of the flows; the queueing delay measured here is added to it",
+                   TimeValue (MilliSeconds (100)),
+                   MakeTimeAccessor (&PiQueueDisc::m_baseRtt),
+                   MakeTimeChecker ())
+    .AddAttribute ("MinFlows",
+                   "Lower bound on the estimated number of flows used by AutoTune",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&PiQueueDisc::m_minFlows),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("ThroughputWindow",
+                   "Window over which GetThroughput measures the dequeue rate",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&PiQueueDisc::m_throughputWindow),
+                   MakeTimeChecker ())
+    .AddAttribute ("ThroughputBuckets",
+                   "Number of buckets the throughput window is split into",
+                   UintegerValue (10),
+                   MakeUintegerAccessor (&PiQueueDisc::m_throughputBuckets),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("Histograms",
+                   "True to record the sojourn time and queue length histograms behind the percentiles of GetStats",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&PiQueueDisc::m_histograms),
+                   MakeBooleanChecker ())
+    .AddAttribute ("HistogramFile",
+                   "File the sojourn time and queue length histograms are written to at the end of the run, which turns Histograms on; empty for none",
+                   StringValue (""),
+                   MakeStringAccessor (&PiQueueDisc::m_histFile),
+                   MakeStringChecker ())
     .AddAttribute ("QueueLimit",
                    "Queue limit in bytes/packets",
                    DoubleValue (50),
@@ -63,17 +186,31 @@ TypeId PiQueueDisc::GetTypeId (void)
                    MakeQueueSizeAccessor (&QueueDisc::SetMaxSize,
                                           &QueueDisc::GetMaxSize),
                    MakeQueueSizeChecker ())
+    .AddTraceSource ("Probability",
+                     "Drop probability, updated by the PI controller",
+                     MakeTraceSourceAccessor (&PiQueueDisc::m_dropProb),
+                     "ns3::TracedValueCallback::Double")
+    .AddTraceSource ("SampledQueueLength",
+                     "Queue length in bytes/packets seen by the last update of the drop probability",
+                     MakeTraceSourceAccessor (&PiQueueDisc::m_qSampled),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("QueueDelay",
+                     "Sojourn time of the last dequeued packet",
+                     MakeTraceSourceAccessor (&PiQueueDisc::m_qDelay),
+                     "ns3::TracedValueCallback::Time")
   ;
 
   return tid;
 }
 
 PiQueueDisc::PiQueueDisc ()
-  : QueueDisc ()
+  : QueueDisc (),
+    m_enqueueFn (0),
+    m_updateFn (0),
+    m_advanceFn (0)
 {
 //  NS_LOG_FUNCTION (this);
   m_uv = CreateObject<UniformRandomVariable> ();
-  m_rtrsEvent = Simulator::Schedule (Time (Seconds (1.0 / m_w)), &PiQueueDisc::CalculateP, this);
 }
 
 PiQueueDisc::~PiQueueDisc ()
@@ -85,7 +222,21 @@ void
 PiQueueDisc::DoDispose (void)
 {
 //  NS_LOG_FUNCTION (this);
+  if (!m_histFile.empty () && m_delayHist)
+    {
+      // Two data sets for gnuplot (index 0 and index 1), one bucket per line
+      std::ofstream out (m_histFile.c_str (), std::ios::out | std::ios::trunc);
+      out << "# sojourn time: low (s) high (s) count cdf" << std::endl;
+      m_delayHist->Print (out, TimeStep (1).GetSeconds ());
+      out << std::endl << std::endl;
+      out << "# queue length seen by arrivals: low high count cdf" << std::endl;
+      m_qlenHist->Print (out, 1);
+    }
+#ifdef PI_PROFILE
+  m_profile.Print (std::cout, this);
+#endif
   m_uv = 0;
+  m_queue = 0;
   Simulator::Remove (m_rtrsEvent);
   QueueDisc::DoDispose ();
 }
@@ -117,11 +268,11 @@ PiQueueDisc::GetQueueSize (void)
 //  NS_LOG_FUNCTION (this);
   if (GetMode() == QueueSizeUnit::BYTES)
     {
-      return GetInternalQueue (0)->GetNBytes ();
+      return m_queue->GetNBytes ();
     }
   else if (GetMode() == QueueSizeUnit::PACKETS)
     {
-      return GetInternalQueue (0)->GetNPackets ();
+      return m_queue->GetNPackets ();
     }
   else
     {
@@ -129,27 +280,69 @@ PiQueueDisc::GetQueueSize (void)
     }
 }
 
-uint32_t
+Time
+PiQueueDisc::GetQueueDelay (void)
+{
+//  NS_LOG_FUNCTION (this);
+  return m_qDelay;
+}
+
+uint64_t
 PiQueueDisc::GetDropCount (void)
 {
 //  NS_LOG_FUNCTION (this);
-  uint32_t drops = m_stats.forcedDrop + m_stats.unforcedDrop;
+  uint64_t drops = m_stats.forcedDrop + m_stats.unforcedDrop;
   return drops;
 }
 
-uint32_t
+double
+PiQueueDisc::GetDropProbability (void)
+{
+//  NS_LOG_FUNCTION (this);
+  return m_dropProb;
+}
+
+double
 PiQueueDisc::GetThroughput (void)
 {
 //  NS_LOG_FUNCTION (this);
-  uint32_t packetsDequeued = m_stats.packetsDequeued;
-  m_stats.packetsDequeued = 0;
-  return packetsDequeued * 10;
+  return m_meter.GetWindowRate (Simulator::Now ());
+}
+
+double
+PiQueueDisc::GetInstantThroughput (void)
+{
+//  NS_LOG_FUNCTION (this);
+  return m_meter.GetInstantRate (Simulator::Now ());
+}
+
+double
+PiQueueDisc::GetLifetimeThroughput (void)
+{
+//  NS_LOG_FUNCTION (this);
+  return m_meter.GetLifetimeRate (Simulator::Now ());
 }
 
 PiQueueDisc::Stats
 PiQueueDisc::GetStats ()
 {
 //  NS_LOG_FUNCTION (this);
+  m_stats.packetsDequeued = m_meter.GetTotalPackets ();
+  m_stats.bytesDequeued = m_meter.GetTotalBytes ();
+  if (m_delayHist)
+    {
+      m_stats.delayP50 = TimeStep (m_delayHist->GetPercentile (50));
+      m_stats.delayP99 = TimeStep (m_delayHist->GetPercentile (99));
+      m_stats.delayP999 = TimeStep (m_delayHist->GetPercentile (99.9));
+      m_stats.qlenP50 = m_qlenHist->GetPercentile (50);
+      m_stats.qlenP99 = m_qlenHist->GetPercentile (99);
+      m_stats.qlenP999 = m_qlenHist->GetPercentile (99.9);
+    }
+  else
+    {
+      m_stats.delayP50 = m_stats.delayP99 = m_stats.delayP999 = Time (0);
+      m_stats.qlenP50 = m_stats.qlenP99 = m_stats.qlenP999 = 0;
+    }
   return m_stats;
 }
 
@@ -165,36 +358,78 @@ bool
 PiQueueDisc::DoEnqueue (Ptr<QueueDiscItem> item)
 {
 //  NS_LOG_FUNCTION (this << item);
+  PI_PROFILE_SCOPE (m_profile, ENQUEUE);
+  return (this->*m_enqueueFn) (item);
+}
+
+template <QueueSizeUnit Unit>
+uint32_t
+PiQueueDisc::QueueLength (void) const
+{
+  if (Unit == QueueSizeUnit::BYTES)
+    {
+      return m_queue->GetNBytes ();
+    }
+  return m_queue->GetNPackets ();
+}
+
+template <QueueSizeUnit Unit>
+bool
+PiQueueDisc::DoEnqueueUnit (Ptr<QueueDiscItem> item)
+{
+//  NS_LOG_FUNCTION (this << item);
+
+  if (m_lazyUpdate)
+    {
+      UpdateP<Unit> ();
+    }
+
+  if (m_qlenHist)
+    {
+      m_qlenHist->Add (QueueLength<Unit> ());
+    }
 
+  if (m_autoTune)
+    {
+      m_flowSketch.set (item->Hash () % m_flowSketch.size ());
+    }
 
-  uint32_t nQueued = GetQueueSize ();
+  uint32_t nQueued = QueueLength<Unit> ();
 
-  if ((GetMode () == QueueSizeUnit::PACKETS && nQueued >= m_queueLimit)
-      || (GetMode () == QueueSizeUnit::BYTES && nQueued + item->GetSize () > m_queueLimit))
+  if ((Unit == QueueSizeUnit::PACKETS && nQueued >= m_queueLimit)
+      || (Unit == QueueSizeUnit::BYTES && nQueued + item->GetSize () > m_queueLimit))
     {
       // Drops due to queue limit: reactive
       DropBeforeEnqueue (item, "Forced drop");
       m_stats.forcedDrop++;
-      NS_LOG_LOGIC ("\t QueueLength:: " << GetInternalQueue (0)->GetNPackets ());
+      NS_LOG_LOGIC ("\t QueueLength:: " << m_queue->GetNPackets ());
       return false;
     }
-  else if (DropEarly (item, nQueued))
+  else if (!m_inBurst && DropEarly<Unit> (item))
     {
-      // Early probability drop: proactive
-      DropBeforeEnqueue (item, "Forced drop");
-      m_stats.unforcedDrop++;
-      NS_LOG_LOGIC ("\t QueueLength:: " << GetInternalQueue (0)->GetNPackets ());
-      return false;
+      if (m_useEcn && m_dropProb <= m_markEcnTh && Mark (item, "Unforced mark"))
+        {
+          // Early probability mark: the ECN-capable packet is enqueued
+          m_stats.unforcedMark++;
+        }
+      else
+        {
+          // Early probability drop: proactive
+          DropBeforeEnqueue (item, "Forced drop");
+          m_stats.unforcedDrop++;
+          NS_LOG_LOGIC ("\t QueueLength:: " << m_queue->GetNPackets ());
+          return false;
+        }
     }
 
   // No drop
-  bool retval = GetInternalQueue (0)->Enqueue (item);
-  NS_LOG_LOGIC ("\t QueueLength:: " << GetInternalQueue (0)->GetNPackets ());
+  bool retval = m_queue->Enqueue (item);
+  NS_LOG_LOGIC ("\t QueueLength:: " << m_queue->GetNPackets ());
   // If Queue::Enqueue fails, QueueDisc::Drop is called by the internal queue
   // because QueueDisc::AddInternalQueue sets the drop callback
 
-//  NS_LOG_LOGIC ("\t bytesInQueue  " << GetInternalQueue (0)->GetNBytes ());
-//  NS_LOG_LOGIC ("\t packetsInQueue  " << GetInternalQueue (0)->GetNPackets ());
+//  NS_LOG_LOGIC ("\t bytesInQueue  " << m_queue->GetNBytes ());
+//  NS_LOG_LOGIC ("\t packetsInQueue  " << m_queue->GetNPackets ());
 
   return retval;
 }
@@ -205,74 +440,348 @@ PiQueueDisc::InitializeParams (void)
   m_dropProb = 0;
   m_stats.forcedDrop = 0;
   m_stats.unforcedDrop = 0;
+  m_stats.unforcedMark = 0;
   m_stats.packetsDequeued = 0;
-  m_qOld = 0;
+  m_stats.bytesDequeued = 0;
+  m_stats.controllerUpdates = 0;
+  m_meter.Reset (m_throughputWindow, m_throughputBuckets, Simulator::Now ());
+  // About 15 KB each, so allocated only when asked for
+  if (m_histograms || !m_histFile.empty ())
+    {
+      if (!m_delayHist)
+        {
+          m_delayHist.reset (new PiHistogram ());
+          m_qlenHist.reset (new PiHistogram ());
+        }
+      m_delayHist->Reset ();
+      m_qlenHist->Reset ();
+    }
+  m_packetCtl.SetGains (m_a, m_b);
+  m_packetCtl.SetQueueRef (m_qRef);
+  m_packetCtl.SetMeanPktSize (m_meanPktSize);
+  m_packetCtl.SetAntiWindup (m_antiWindup, m_antiWindupGain);
+  m_packetCtl.Reset ();
+  m_byteCtl.SetGains (m_a, m_b);
+  m_byteCtl.SetQueueRef (m_qRef);
+  m_byteCtl.SetMeanPktSize (m_meanPktSize);
+  m_byteCtl.SetAntiWindup (m_antiWindup, m_antiWindupGain);
+  m_byteCtl.Reset ();
+  m_qDelay = Time ();
+  m_qSampled = 0;
+  m_lastErr = -m_qRef;
+  m_interval = 1.0 / m_w;
+  m_burstEnd = Simulator::Now () + m_maxBurst;
+  m_inBurst = m_maxBurst.IsStrictlyPositive ();
+  m_avgDqRate = 0;
+  m_dqStart = Time ();
+  m_dqCount = 0;
+  m_inMeasurement = false;
+  m_nextTune = Simulator::Now () + m_tuneInterval;
+  m_lastDequeue = Simulator::Now ();
+  m_busy = false;
+  m_tuneBusyTime = Time ();
+  m_tuneBytes = 0;
+  m_tunePackets = 0;
+  m_tuneQSum = 0;
+  m_tuneSamples = 0;
+  m_flowSketch.reset ();
+
+  // Attributes are only known from here on, so the first sample is
+  // scheduled now rather than in the constructor
+  if (m_lazyUpdate)
+    {
+      m_nextUpdate = Simulator::Now () + Seconds (1.0 / m_w);
+    }
+  else
+    {
+      m_rtrsEvent = Simulator::Schedule (Time (Seconds (1.0 / m_w)), &PiQueueDisc::CalculateP, this);
+    }
 }
 
-bool PiQueueDisc::DropEarly (Ptr<QueueDiscItem> item, uint32_t qSize)
+template <QueueSizeUnit Unit>
+PiQueueDisc::Controller<Unit> &
+PiQueueDisc::GetController (void)
 {
-//  NS_LOG_FUNCTION (this << item << qSize);
+  if constexpr (Unit == QueueSizeUnit::BYTES)
+    {
+      return m_byteCtl;
+    }
+  else
+    {
+      return m_packetCtl;
+    }
+}
 
-  double p = m_dropProb;
-  bool earlyDrop = true;
+template <QueueSizeUnit Unit>
+bool PiQueueDisc::DropEarly (Ptr<QueueDiscItem> item)
+{
+//  NS_LOG_FUNCTION (this << item);
+  PI_PROFILE_SCOPE (m_profile, DROP_EARLY);
+  Controller<Unit> &ctl = GetController<Unit> ();
+  auto uniform = [this] () { return m_uv->GetValue (); };
 
-  if (GetMode () == QueueSizeUnit::BYTES)
+  if (m_geometricDrop)
     {
-      p = p * item->GetSize() / m_meanPktSize;
+      // The distance to the next drop was drawn when p last changed or at
+      // the previous drop: no random number is needed for this packet
+      if (ctl.SkipEarly (item->GetSize ()))
+        {
+          return false;
+        }
+      ctl.DrawSkipCount (uniform);
+      return true;
     }
-  p = p > 1 ? 1 : p;
 
-  double u =  m_uv->GetValue ();
+  return ctl.DropEarly (item->GetSize (), uniform);
+}
 
-  if (u > p)
+void PiQueueDisc::CalculateP ()
+{
+//  NS_LOG_FUNCTION (this);
+  PI_PROFILE_SCOPE (m_profile, CALCULATE_P);
+  if (!m_adaptiveSampling)
     {
-      earlyDrop = false;
+      (this->*m_advanceFn) (1);
+      m_rtrsEvent = Simulator::Schedule (Time (Seconds (1.0 / m_w)), &PiQueueDisc::CalculateP, this);
+      return;
     }
-  if (!earlyDrop)
+
+  // A - B is the integral gain times 1/W and B the proportional gain:
+  // scaling A - B with the interval that just elapsed keeps the
+  // continuous-time controller that A, B and W describe
+  double ratio = m_interval * m_w;
+  double a = m_b + (m_a - m_b) * ratio;
+  m_packetCtl.SetGains (a, m_b);
+  m_byteCtl.SetGains (a, m_b);
+  double errOld = m_lastErr;
+  (this->*m_advanceFn) (1);
+
+  // Change of the error per nominal interval 1/W, so that it does not
+  // shrink with the interval. While p is held at 0 by a short queue,
+  // the error is large but nothing is controlled
+  double change = std::fabs (m_lastErr - errOld) / ratio;
+  double err = std::fabs (m_lastErr);
+  bool idle = m_dropProb == 0 && m_lastErr <= 0;
+  if (change > m_adaptiveTh || (!idle && err > m_adaptiveTh))
     {
-      return false;
+      m_interval = std::max (m_interval / 2, 1.0 / m_maxW);
     }
-
-  return true;
+  else if (idle)
+    {
+      m_interval = 1.0 / m_minW;
+    }
+  else if (change < m_adaptiveTh / 2 && err < m_adaptiveTh / 2)
+    {
+      m_interval = std::min (m_interval * 2, 1.0 / m_minW);
+    }
+  m_rtrsEvent = Simulator::Schedule (Time (Seconds (m_interval)), &PiQueueDisc::CalculateP, this);
 }
 
-void PiQueueDisc::CalculateP ()
+template <QueueSizeUnit Unit>
+void PiQueueDisc::UpdateP (void)
 {
 //  NS_LOG_FUNCTION (this);
-  double p = 0.0;
-  uint32_t qlen = GetQueueSize ();
-  if (GetMode () == QueueSizeUnit::BYTES)
+  Time now = Simulator::Now ();
+  if (now < m_nextUpdate)
     {
-      p = m_a * ((qlen * 1.0 / m_meanPktSize) - m_qRef) - m_b * ((m_qOld * 1.0 / m_meanPktSize) - m_qRef) + m_dropProb;
+      return;
     }
-  else
+
+  Time period = Seconds (1.0 / m_w);
+  uint64_t intervals = 1 + (now - m_nextUpdate).GetTimeStep () / period.GetTimeStep ();
+  m_nextUpdate += Time (period.GetTimeStep () * intervals);
+  AdvanceP<Unit> (intervals);
+}
+
+template <QueueSizeUnit Unit>
+void PiQueueDisc::AdvanceP (uint64_t intervals)
+{
+//  NS_LOG_FUNCTION (this << intervals);
+  PI_PROFILE_SCOPE (m_profile, ADVANCE_P);
+  Controller<Unit> &ctl = GetController<Unit> ();
+  m_stats.controllerUpdates++;
+  m_qSampled = QueueLength<Unit> ();
+  double q = m_qSampled;
+  if (Unit == QueueSizeUnit::BYTES)
+    {
+      q = q * m_invMeanPktSize;
+    }
+
+  // In delay mode the queue delay is estimated from the departure rate, as
+  // in PIE; its error is scaled back to packets by that rate, so A and B
+  // keep their meaning and the target follows the link rate
+  double err = ctl.GetLengthError (m_qSampled);
+  if (!m_delayRef.IsZero () && m_avgDqRate > 0)
+    {
+      err = ctl.GetDelayError (m_queue->GetNBytes (), m_avgDqRate, m_delayRef.GetSeconds ());
+    }
+  double errOld = m_lastErr;
+  m_lastErr = err;
+
+  bool changed = ctl.Update (err, intervals);
+  m_dropProb = ctl.GetDropProbability ();
+
+  if (m_maxBurst.IsStrictlyPositive ())
+    {
+      // As in PIE: an idle queue earns the whole allowance again, and early
+      // drops stay off until it is used up. Idle is p = 0 and less than half
+      // of the reference at this and the previous update
+      double ref = m_qRef;
+      if (!m_delayRef.IsZero () && m_avgDqRate > 0)
+        {
+          ref = m_delayRef.GetSeconds () * m_avgDqRate * m_invMeanPktSize;
+        }
+      Time now = Simulator::Now ();
+      if (m_dropProb == 0 && 2 * err < -ref && 2 * errOld < -ref)
+        {
+          m_burstEnd = now + m_maxBurst;
+        }
+      m_inBurst = now < m_burstEnd;
+    }
+
+  if (m_geometricDrop && changed)
+    {
+      // Packets are dropped independently, so the distance to the next drop
+      // can be redrawn from the new probability at any time
+      auto uniform = [this] () { return m_uv->GetValue (); };
+      ctl.DrawSkipCount (uniform);
+    }
+
+  if (m_autoTune)
+    {
+      m_tuneQSum += q * intervals;
+      m_tuneSamples += intervals;
+      if (Simulator::Now () >= m_nextTune)
+        {
+          AutoTune ();
+        }
+    }
+}
+
+void PiQueueDisc::AutoTune (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_nextTune = Simulator::Now () + m_tuneInterval;
+
+  // Capacity: rate at which a backlog is served, in mean-size packets/s
+  double busy = m_tuneBusyTime.GetSeconds ();
+  double served = (m_mode == QueueSizeUnit::BYTES) ? m_tuneBytes * m_invMeanPktSize : m_tunePackets;
+  double c = busy > 0 ? served / busy : 0;
+
+  // Flows: linear counting over the hashes of the arrivals
+  double m = m_flowSketch.size ();
+  double zeros = m - m_flowSketch.count ();
+  double n = (zeros > 0) ? m * std::log (m / zeros) : m * std::log (m);
+  n = std::max (n, static_cast<double> (m_minFlows));
+
+  // RTT: propagation delay plus the mean queueing delay seen here
+  double qAvg = m_tuneSamples > 0 ? m_tuneQSum / m_tuneSamples : 0;
+  double r = m_baseRtt.GetSeconds () + (c > 0 ? qAvg / c : 0);
+
+  m_tuneBusyTime = Time ();
+  m_tuneBytes = 0;
+  m_tunePackets = 0;
+  m_tuneQSum = 0;
+  m_tuneSamples = 0;
+  m_flowSketch.reset ();
+
+  if (c <= 0 || r <= 0)
     {
-      p = m_a * (qlen - m_qRef) - m_b * (m_qOld - m_qRef) + m_dropProb;
+      NS_LOG_LOGIC ("No backlog served since the last tuning, A and B kept");
+      return;
     }
-  p = (p < 0) ? 0 : p;
-  p = (p > 1) ? 1 : p;
 
-  m_dropProb = p;
-  m_qOld = qlen;
-  m_rtrsEvent = Simulator::Schedule (Time (Seconds (1.0 / m_w)), &PiQueueDisc::CalculateP, this);
+  // Plant (Hollot et al.): (C^2 / 2N) e^{-sR} / ((s + 2N / (R^2 C)) (s + 1 / R)).
+  // The PI zero cancels the first pole and the crossover is placed on it.
+  double z = 2 * n / (r * r * c);
+  double wg = z;
+  double k = wg * std::sqrt (wg * wg * r * r + 1) * (2 * n) * (2 * n) / std::pow (r * c, 3);
+
+  // Discretized with the sampling period T = 1 / W:
+  // p (k) = p (k - 1) + a (q (k) - qRef) - b (q (k - 1) - qRef)
+  m_b = k / z;
+  m_a = m_b + k / m_w;
+  m_packetCtl.SetGains (m_a, m_b);
+  m_byteCtl.SetGains (m_a, m_b);
+
+  NS_LOG_INFO ("AutoTune: C " << c << " pkt/s, N " << n << ", R " << r << " s -> A " << m_a << ", B " << m_b);
 }
 
 Ptr<QueueDiscItem>
 PiQueueDisc::DoDequeue ()
 {
 //  NS_LOG_FUNCTION (this);
+  PI_PROFILE_SCOPE (m_profile, DEQUEUE);
+
+  if (m_lazyUpdate)
+    {
+      (this->*m_updateFn) ();
+    }
 
-  if (GetInternalQueue (0)->IsEmpty ())
+  if (m_queue->IsEmpty ())
     {
 //      NS_LOG_LOGIC ("Queue empty");
-      NS_LOG_LOGIC ("\t QueueLength:: " << GetInternalQueue (0)->GetNPackets ());
+      NS_LOG_LOGIC ("\t QueueLength:: " << m_queue->GetNPackets ());
       return 0;
     }
 
-  Ptr<QueueDiscItem> item = StaticCast<QueueDiscItem> (GetInternalQueue (0)->Dequeue ());
-  m_stats.packetsDequeued += item->GetSize ();
+  Ptr<QueueDiscItem> item = StaticCast<QueueDiscItem> (m_queue->Dequeue ());
+  Time now = Simulator::Now ();
+  m_meter.Record (now, item->GetSize ());
+
+  // QueueDisc::Enqueue stamps every accepted item with its arrival time
+  Time sojourn = now - item->GetTimeStamp ();
+  m_qDelay = sojourn;
+  if (m_delayHist)
+    {
+      m_delayHist->Add (sojourn.GetTimeStep ());
+    }
+
+  if (!m_delayRef.IsZero ())
+    {
+      // Departure rate estimation, as in PIE: measure how long it takes to
+      // send DequeueThreshold bytes while enough of a backlog is present
+      uint32_t bytes = m_queue->GetNBytes ();
+      if (bytes >= m_dqThreshold && !m_inMeasurement)
+        {
+          m_dqStart = now;
+          m_dqCount = 0;
+          m_inMeasurement = true;
+        }
+
+      if (m_inMeasurement)
+        {
+          m_dqCount += item->GetSize ();
+          if (m_dqCount >= m_dqThreshold)
+            {
+              double elapsed = (now - m_dqStart).GetSeconds ();
+              if (elapsed > 0)
+                {
+                  double rate = m_dqCount / elapsed;
+                  m_avgDqRate = (m_avgDqRate == 0) ? rate : 0.5 * m_avgDqRate + 0.5 * rate;
+                }
+              m_dqStart = now;
+              m_dqCount = 0;
+              m_inMeasurement = bytes > m_dqThreshold;
+            }
+        }
+    }
+
+  if (m_autoTune)
+    {
+      // Only the gaps between dequeues of a standing backlog measure the
+      // link rate; the first dequeue after an idle period does not
+      if (m_busy)
+        {
+          m_tuneBusyTime += now - m_lastDequeue;
+          m_tuneBytes += item->GetSize ();
+          m_tunePackets++;
+        }
+      m_lastDequeue = now;
+      m_busy = !m_queue->IsEmpty ();
+    }
   NS_LOG_LOGIC ("\t BytesDequeued:: " << item->GetSize ());
-  NS_LOG_LOGIC ("\t QueueLength:: " << GetInternalQueue (0)->GetNPackets ());
+  NS_LOG_LOGIC ("\t QueueLength:: " << m_queue->GetNPackets ());
   return item;
 }
 
@@ -280,16 +789,17 @@ Ptr<const QueueDiscItem>
 PiQueueDisc::DoPeek () const
 {
 //  NS_LOG_FUNCTION (this);
-  if (GetInternalQueue (0)->IsEmpty ())
+  PI_PROFILE_SCOPE (m_profile, PEEK);
+  if (m_queue->IsEmpty ())
     {
 //      NS_LOG_LOGIC ("Queue empty");
       return 0;
     }
 
-  Ptr<const QueueDiscItem> item = StaticCast<const QueueDiscItem> (GetInternalQueue (0)->Peek ());
+  Ptr<const QueueDiscItem> item = StaticCast<const QueueDiscItem> (m_queue->Peek ());
 
-//  NS_LOG_LOGIC ("Number packets " << GetInternalQueue (0)->GetNPackets ());
-//  NS_LOG_LOGIC ("Number bytes " << GetInternalQueue (0)->GetNBytes ());
+//  NS_LOG_LOGIC ("Number packets " << m_queue->GetNPackets ());
+//  NS_LOG_LOGIC ("Number bytes " << m_queue->GetNBytes ());
 
   return item;
 }
@@ -335,6 +845,55 @@ PiQueueDisc::CheckConfig (void)
       return false;
     }
 
+  // Looked up once: the hot path goes through m_queue only
+  m_queue = GetInternalQueue (0);
+
+  if (m_meanPktSize == 0)
+    {
+      NS_LOG_ERROR ("MeanPktSize must be positive");
+      return false;
+    }
+  m_invMeanPktSize = 1.0 / m_meanPktSize;
+
+  if (m_adaptiveSampling && m_lazyUpdate)
+    {
+      // Lazy mode replays whole intervals of 1/W, which adaptive sampling does not have
+      NS_LOG_ERROR ("AdaptiveSampling cannot be used with LazyUpdate");
+      return false;
+    }
+
+  if (m_adaptiveSampling && !(m_minW > 0 && m_minW <= m_w && m_w <= m_maxW))
+    {
+      NS_LOG_ERROR ("AdaptiveSampling needs 0 < MinW <= W <= MaxW");
+      return false;
+    }
+
+  if (!m_throughputWindow.IsStrictlyPositive ())
+    {
+      NS_LOG_ERROR ("ThroughputWindow must be positive");
+      return false;
+    }
+
+  // Pick the per-packet code path once, instead of testing the mode on
+  // every enqueue
+  if (m_mode == QueueSizeUnit::BYTES)
+    {
+      m_enqueueFn = &PiQueueDisc::DoEnqueueUnit<QueueSizeUnit::BYTES>;
+      m_updateFn = &PiQueueDisc::UpdateP<QueueSizeUnit::BYTES>;
+      m_advanceFn = &PiQueueDisc::AdvanceP<QueueSizeUnit::BYTES>;
+    }
+  else if (m_mode == QueueSizeUnit::PACKETS)
+    {
+      m_enqueueFn = &PiQueueDisc::DoEnqueueUnit<QueueSizeUnit::PACKETS>;
+      m_updateFn = &PiQueueDisc::UpdateP<QueueSizeUnit::PACKETS>;
+      m_advanceFn = &PiQueueDisc::AdvanceP<QueueSizeUnit::PACKETS>;
+    }
+  else
+    {
+      NS_LOG_ERROR ("Unknown PI mode");
+      return false;
+    }
+
   return true;
 }
 
@@ -2,14 +2,21 @@
 #define PI_QUEUE_DISC_H
 
 #include <queue>
+#include <bitset>
+#include <memory>
 #include "ns3/packet.h"
 #include "ns3/queue-disc.h"
 #include "ns3/nstime.h"
 #include "ns3/boolean.h"
+#include "ns3/traced-value.h"
 #include "ns3/data-rate.h"
 #include "ns3/timer.h"
 #include "ns3/event-id.h"
 #include "ns3/random-variable-stream.h"
+#include "pi-throughput-meter.h"
+#include "pi-histogram.h"
+#include "pi-controller.h"
+#include "pi-profiler.h"
 
 namespace ns3 {
 
@@ -45,9 +52,18 @@ public:
    */
   typedef struct
   {
-    uint32_t unforcedDrop;      //!< Early probability drops: proactive
-    uint32_t forcedDrop;        //!< Drops due to queue limit: reactive
-    uint32_t packetsDequeued;
+    uint64_t unforcedDrop;      //!< Early probability drops: proactive
+    uint64_t forcedDrop;        //!< Drops due to queue limit: reactive
+    uint64_t unforcedMark;      //!< Early probability marks: proactive
+    uint64_t packetsDequeued;   //!< Packets dequeued
+    uint64_t bytesDequeued;     //!< Bytes dequeued
+    uint64_t controllerUpdates; //!< Drop probability updates (each may cover several intervals)
+    Time delayP50;              //!< Median sojourn time (percentiles are 0 unless Histograms is set)
+    Time delayP99;              //!< 99th percentile of the sojourn time
+    Time delayP999;             //!< 99.9th percentile of the sojourn time
+    uint64_t qlenP50;           //!< Median queue length seen by arrivals, in bytes/packets
+    uint64_t qlenP99;           //!< 99th percentile of the queue length seen by arrivals
+    uint64_t qlenP999;          //!< 99.9th percentile of the queue length seen by arrivals
   } Stats;
 
   /**
@@ -71,6 +87,13 @@ public:
    */
   uint32_t GetQueueSize (void);
 
+  /**
+   * \brief Get the sojourn time of the last dequeued packet.
+   *
+   * \returns The time the packet spent in the queue.
+   */
+  Time GetQueueDelay (void);
+
   /**
    * \brief Set the limit of the queue in bytes or packets.
    *
@@ -81,12 +104,35 @@ public:
   /**
    * \brief Get drop count
    */
-  uint32_t GetDropCount (void);
-  
+  uint64_t GetDropCount (void);
+
+  /**
+   * \brief Get the drop probability computed at the last update.
+   *
+   * \returns The drop probability.
+   */
+  double GetDropProbability (void);
+
   /**
-   * \brief Get throughput
+   * \brief Get the dequeue rate over the last ThroughputWindow
+   *
+   * \returns The rate in bytes per second.
    */
-  uint32_t GetThroughput (void);
+  double GetThroughput (void);
+
+  /**
+   * \brief Get the dequeue rate over the last ThroughputWindow / ThroughputBuckets
+   *
+   * \returns The rate in bytes per second.
+   */
+  double GetInstantThroughput (void);
+
+  /**
+   * \brief Get the dequeue rate since the queue disc was initialized
+   *
+   * \returns The rate in bytes per second.
+   */
+  double GetLifetimeThroughput (void);
   /**
    * \brief Get PI statistics after running.
    *
@@ -121,40 +167,155 @@ private:
    */
   virtual void InitializeParams (void);
 
+  /**
+   * \brief Enqueue for a fixed queue size unit
+   *
+   * One instance per unit is compiled; CheckConfig picks the one matching
+   * the Mode attribute so that the per-packet path does not branch on it.
+   *
+   * \param item item to enqueue
+   * \returns true if the item was enqueued
+   */
+  template <QueueSizeUnit Unit>
+  bool DoEnqueueUnit (Ptr<QueueDiscItem> item);
+
+  /**
+   * \brief Get the current queue length in the given unit
+   * \returns the number of bytes or packets in the internal queue
+   */
+  template <QueueSizeUnit Unit>
+  uint32_t QueueLength (void) const;
+
   /**
    * \brief Check if a packet needs to be dropped due to probability drop
    * \param item queue item
-   * \param qSize queue size
    * \returns 0 for no drop, 1 for drop
    */
-  bool DropEarly (Ptr<QueueDiscItem> item, uint32_t qSize);
+  template <QueueSizeUnit Unit>
+  bool DropEarly (Ptr<QueueDiscItem> item);
+
+  /// PI controller working in the queue size unit Unit
+  template <QueueSizeUnit Unit>
+  using Controller = PiController<Unit == QueueSizeUnit::BYTES ? PiUnit::BYTES : PiUnit::PACKETS>;
+
+  /**
+   * \brief Get the controller of a mode
+   * \returns m_byteCtl or m_packetCtl
+   */
+  template <QueueSizeUnit Unit>
+  Controller<Unit> &GetController (void);
+
+  /**
+   * \brief Recompute A and B from the current link, flow and RTT estimates
+   *
+   * Uses the PI design rules of Hollot et al. (INFOCOM 2001): the controller
+   * zero cancels the TCP window pole z = 2N / (R^2 C), and the gain puts the
+   * loop crossover at that same frequency.
+   */
+  void AutoTune (void);
 
   /**
    * Periodically update the drop probability based on the delay samples:
    * not only the current delay sample but also the trend where the delay
    * is going, up or down
+   *
+   * With AdaptiveSampling the next interval is halved while the error or
+   * its change exceeds AdaptiveThreshold, doubled while both are below half
+   * of it, and set to 1/MinW while the queue is too short to drop.
    */
   void CalculateP ();
 
+  /**
+   * \brief Bring the drop probability up to date in lazy mode
+   *
+   * Replays, in closed form, every sampling interval that elapsed since the
+   * last update. The queue length cannot change between two enqueue/dequeue
+   * events, so each missed interval sees the same sample.
+   */
+  template <QueueSizeUnit Unit>
+  void UpdateP (void);
+
+  /**
+   * \brief Apply the PI control law for a number of sampling intervals
+   *
+   * The current queue length is used as the sample of every interval.
+   *
+   * \param intervals number of consecutive intervals (at least 1)
+   */
+  template <QueueSizeUnit Unit>
+  void AdvanceP (uint64_t intervals);
+
   Stats m_stats;                                //!< PI statistics
 
   // ** Variables supplied by user
   QueueSizeUnit m_mode;                      //!< Mode (bytes or packets)
   double m_queueLimit;                          //!< Queue limit in bytes / packets
   uint32_t m_meanPktSize;                       //!< Average packet size in bytes
+  double m_invMeanPktSize;                      //!< 1 / m_meanPktSize, set in CheckConfig
   double m_qRef;                                //!< Desired queue size
   double m_a;                                   //!< Parameter to pi controller
   double m_b;                                   //!< Parameter to pi controller
   double m_w;                                   //!< Sampling frequency (Number of times per second)
+  Time m_delayRef;                              //!< Desired queue delay, zero to regulate the queue size instead
+  uint32_t m_dqThreshold;                       //!< Minimum queue size in bytes before dequeue rate is measured
+  bool m_lazyUpdate;                            //!< Update the drop probability on enqueue/dequeue instead of on a timer
+  bool m_adaptiveSampling;                      //!< Vary the sampling interval with the error
+  double m_minW;                                //!< Lowest sampling frequency in adaptive mode
+  double m_maxW;                                //!< Highest sampling frequency in adaptive mode
+  double m_adaptiveTh;                          //!< Error and error change, in packets, that speed up adaptive sampling
+  PiAntiWindup m_antiWindup;                    //!< Anti-windup of the integral term
+  double m_antiWindupGain;                      //!< Back-calculation share of the clamped-off output
+  Time m_maxBurst;                              //!< Burst allowance after an idle period, zero for none
+  bool m_useEcn;                                //!< True if ECN is used (packets are marked instead of being dropped)
+  double m_markEcnTh;                           //!< ECN marking threshold (probability above which packets are dropped)
+  bool m_geometricDrop;                         //!< Draw the distance to the next early drop instead of testing every packet
+  bool m_autoTune;                              //!< Recompute A and B from online estimates
+  Time m_tuneInterval;                          //!< Time between two recomputations of A and B
+  Time m_baseRtt;                               //!< Round-trip propagation delay of the flows
+  uint32_t m_minFlows;                          //!< Lower bound on the estimated number of flows
+  Time m_throughputWindow;                      //!< Window of the throughput meter
+  uint32_t m_throughputBuckets;                 //!< Number of buckets of the throughput meter
+  bool m_histograms;                            //!< Record the sojourn time and queue length histograms
+  std::string m_histFile;                       //!< File the histograms are written to on dispose, empty for none
 
   // ** Variables maintained by PI
-  double m_dropProb;                            //!< Variable used in calculation of drop probability
-  Time m_qDelay;                                //!< Current value of queue delay
-  uint32_t m_qOld;                              //!< Old value of queue length
-  double m_count;                               //!< Number of packets since last drop
-  uint32_t m_countBytes;                        //!< Number of bytes since last drop
+  PiThroughputMeter m_meter;                    //!< Dequeue rate
+  std::unique_ptr<PiHistogram> m_delayHist;     //!< Sojourn times, in time steps; null unless histograms are on
+  std::unique_ptr<PiHistogram> m_qlenHist;      //!< Queue lengths seen by arrivals; null unless histograms are on
+  Controller<QueueSizeUnit::PACKETS> m_packetCtl;  //!< Control law and drop decision in packet mode
+  Controller<QueueSizeUnit::BYTES> m_byteCtl;   //!< Control law and drop decision in byte mode
+  TracedValue<double> m_dropProb;               //!< Drop probability of the controller in use
+  TracedValue<uint32_t> m_qSampled;             //!< Queue length seen by the last controller update
+  double m_lastErr;                             //!< Error, in packets, of the last controller update
+  double m_interval;                            //!< Current sampling interval in seconds
+  Time m_burstEnd;                              //!< End of the current burst allowance
+  bool m_inBurst;                               //!< True while the burst allowance is not used up
+  TracedValue<Time> m_qDelay;                   //!< Sojourn time of the last dequeued packet
+  double m_avgDqRate;                           //!< Time averaged dequeue rate in bytes/s
+  Time m_dqStart;                               //!< Start time of the current dequeue rate measurement
+  uint64_t m_dqCount;                           //!< Bytes dequeued in the current measurement
+  bool m_inMeasurement;                         //!< True if a dequeue rate measurement is in progress
   EventId m_rtrsEvent;                          //!< Event used to decide the decision of interval of drop probability calculation
+  Time m_nextUpdate;                            //!< Next sampling instant in lazy mode
+  Time m_nextTune;                              //!< Next recomputation of A and B
+  Time m_lastDequeue;                           //!< Time of the last dequeue
+  bool m_busy;                                  //!< True if the queue was not empty after the last dequeue
+  Time m_tuneBusyTime;                          //!< Time spent serving a backlog since the last tuning
+  uint64_t m_tuneBytes;                         //!< Bytes dequeued during m_tuneBusyTime
+  uint64_t m_tunePackets;                       //!< Packets dequeued during m_tuneBusyTime
+  double m_tuneQSum;                            //!< Sum of the queue samples since the last tuning
+  uint64_t m_tuneSamples;                       //!< Number of queue samples since the last tuning
+  std::bitset<1024> m_flowSketch;               //!< Linear counting sketch of the flows seen since the last tuning
   Ptr<UniformRandomVariable> m_uv;              //!< Rng stream
+  Ptr<InternalQueue> m_queue;                   //!< Internal queue, cached by CheckConfig
+#ifdef PI_PROFILE
+  mutable PiProfiler m_profile;                 //!< Hot-path call counts and times, printed on dispose
+#endif
+
+  // ** Mode-specialized members, selected in CheckConfig
+  bool (PiQueueDisc::*m_enqueueFn) (Ptr<QueueDiscItem>);  //!< DoEnqueueUnit for m_mode
+  void (PiQueueDisc::*m_updateFn) (void);                 //!< UpdateP for m_mode
+  void (PiQueueDisc::*m_advanceFn) (uint64_t);            //!< AdvanceP for m_mode
 };
 
 };   // namespace ns3
@@ -0,0 +1,121 @@
+
+#include "ns3/log.h"
+#include "pi-throughput-meter.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("PiThroughputMeter");
+
+PiThroughputMeter::PiThroughputMeter ()
+  : m_width (1),
+    m_start (0),
+    m_current (0),
+    m_windowBytes (0),
+    m_totalBytes (0),
+    m_totalPackets (0)
+{
+}
+
+void
+PiThroughputMeter::Reset (Time window, uint32_t buckets, Time now)
+{
+  NS_LOG_FUNCTION (this << window << buckets << now);
+  NS_ASSERT (buckets > 0);
+
+  m_ring.assign (buckets, 0);
+
+  m_width = window.GetTimeStep () / buckets;
+  m_width = (m_width < 1) ? 1 : m_width;
+  m_start = now.GetTimeStep ();
+  m_current = 0;
+  m_windowBytes = 0;
+  m_totalBytes = 0;
+  m_totalPackets = 0;
+}
+
+void
+PiThroughputMeter::Advance (Time now)
+{
+  int64_t bucket = (now.GetTimeStep () - m_start) / m_width;
+  if (bucket <= m_current)
+    {
+      return;
+    }
+
+  // Clear the buckets entered since the last call; after a whole window
+  // without departures that is every bucket, but never more
+  int64_t size = m_ring.size ();
+  int64_t n = bucket - m_current;
+  n = (n > size) ? size : n;
+  for (int64_t i = 1; i <= n; i++)
+    {
+      uint64_t &b = m_ring[(m_current + i) % size];
+      m_windowBytes -= b;
+      b = 0;
+    }
+  m_current = bucket;
+}
+
+void
+PiThroughputMeter::Record (Time now, uint32_t bytes)
+{
+  Advance (now);
+  m_ring[m_current % m_ring.size ()] += bytes;
+  m_windowBytes += bytes;
+  m_totalBytes += bytes;
+  m_totalPackets++;
+}
+
+double
+PiThroughputMeter::GetInstantRate (Time now)
+{
+  Advance (now);
+  if (m_current == 0)
+    {
+      // No complete bucket yet
+      return GetLifetimeRate (now);
+    }
+  uint64_t bytes = m_ring[(m_current - 1) % m_ring.size ()];
+  return bytes / TimeStep (m_width).GetSeconds ();
+}
+
+double
+PiThroughputMeter::GetWindowRate (Time now)
+{
+  Advance (now);
+  // The ring holds the complete buckets before the current one and the
+  // elapsed part of the current one
+  int64_t elapsed = now.GetTimeStep () - m_start;
+  int64_t covered = (m_ring.size () - 1) * m_width + elapsed - m_current * m_width;
+  covered = (covered > elapsed) ? elapsed : covered;
+  if (covered <= 0)
+    {
+      return 0;
+    }
+  return m_windowBytes / TimeStep (covered).GetSeconds ();
+}
+
+double
+PiThroughputMeter::GetLifetimeRate (Time now) const
+{
+  double elapsed = (now - TimeStep (m_start)).GetSeconds ();
+  if (elapsed <= 0)
+    {
+      return 0;
+    }
+  return m_totalBytes / elapsed;
+}
+
+uint64_t
+PiThroughputMeter::GetTotalBytes (void) const
+{
+  return m_totalBytes;
+}
+
+uint64_t
+PiThroughputMeter::GetTotalPackets (void) const
+{
+  return m_totalPackets;
+}
+
+} //namespace ns3
@@ -0,0 +1,103 @@
+#ifndef PI_THROUGHPUT_METER_H
+#define PI_THROUGHPUT_METER_H
+
+#include <vector>
+#include "ns3/nstime.h"
+
+namespace ns3 {
+
+/**
+ * \ingroup traffic-control
+ *
+ * \brief Departure rate over a sliding window of time buckets
+ *
+ * The window is split into a fixed number of buckets kept in a ring. A
+ * departure adds to the bucket of the current time; buckets that fall out
+ * of the window are cleared as time moves on, each at most once, so the
+ * cost per departure is constant. The sums over the ring are kept up to
+ * date, and queries never reset anything.
+ */
+class PiThroughputMeter
+{
+public:
+  /**
+   * \brief PiThroughputMeter Constructor
+   */
+  PiThroughputMeter ();
+
+  /**
+   * \brief Clear all counters and start measuring
+   *
+   * \param window length of the sliding window
+   * \param buckets number of buckets the window is split into
+   * \param now current time
+   */
+  void Reset (Time window, uint32_t buckets, Time now);
+
+  /**
+   * \brief Account for a departure
+   *
+   * \param now current time, not before the previous call
+   * \param bytes size of the departed packet
+   */
+  void Record (Time now, uint32_t bytes);
+
+  /**
+   * \brief Get the rate over the last complete bucket
+   *
+   * \param now current time
+   * \returns The rate in bytes per second.
+   */
+  double GetInstantRate (Time now);
+
+  /**
+   * \brief Get the rate over the sliding window
+   *
+   * Before a whole window has elapsed the rate is taken over the time
+   * since the meter was reset.
+   *
+   * \param now current time
+   * \returns The rate in bytes per second.
+   */
+  double GetWindowRate (Time now);
+
+  /**
+   * \brief Get the rate since the meter was reset
+   *
+   * \param now current time
+   * \returns The rate in bytes per second.
+   */
+  double GetLifetimeRate (Time now) const;
+
+  /**
+   * \brief Get the number of bytes departed since the meter was reset
+   * \returns The number of bytes.
+   */
+  uint64_t GetTotalBytes (void) const;
+
+  /**
+   * \brief Get the number of packets departed since the meter was reset
+   * \returns The number of packets.
+   */
+  uint64_t GetTotalPackets (void) const;
+
+private:
+  /**
+   * \brief Move the current bucket to the given time
+   *
+   * \param now current time
+   */
+  void Advance (Time now);
+
+  std::vector<uint64_t> m_ring;                 //!< Bytes departed in each bucket of the window
+  int64_t m_width;                              //!< Bucket width, in time steps
+  int64_t m_start;                              //!< Reset time, in time steps
+  int64_t m_current;                            //!< Number of the current bucket since the reset
+  uint64_t m_windowBytes;                       //!< Bytes in all buckets of the ring
+  uint64_t m_totalBytes;                        //!< Bytes since the reset
+  uint64_t m_totalPackets;                      //!< Packets since the reset
+};
+
+};   // namespace ns3
+
+#endif
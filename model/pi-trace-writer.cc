@@ -0,0 +1,249 @@
+
+#include <cstdio>
+#include <cstring>
+#include "pi-trace-writer.h"
+
+namespace ns3 {
+
+static const char PI_TRACE_MAGIC[8] = {'P', 'I', 'T', 'R', 'A', 'C', 'E', '2'};
+static const char PI_TRACE_MAGIC_V1[8] = {'P', 'I', 'T', 'R', 'A', 'C', 'E', '1'};
+
+const uint32_t PiTraceWriter::MAX_BLOCK_SAMPLES;
+
+PiTraceWriter::PiTraceWriter ()
+  : m_format (TEXT),
+    m_blockSamples (1),
+    m_async (false),
+    m_open (false),
+    m_hasPending (false),
+    m_stop (false)
+{
+}
+
+PiTraceWriter::~PiTraceWriter ()
+{
+  Close ();
+}
+
+bool
+PiTraceWriter::Open (const std::string &fileName, Format format, uint32_t blockSamples, bool async)
+{
+  Close ();
+  m_file.open (fileName.c_str (), std::ios::out | std::ios::trunc | std::ios::binary);
+  if (!m_file)
+    {
+      return false;
+    }
+  m_format = format;
+  m_blockSamples = (blockSamples > 0) ? blockSamples : 1;
+  m_blockSamples = (m_blockSamples < MAX_BLOCK_SAMPLES) ? m_blockSamples : MAX_BLOCK_SAMPLES;
+  if (format == BINARY)
+    {
+      m_file.write (PI_TRACE_MAGIC, sizeof (PI_TRACE_MAGIC));
+      m_file.write (reinterpret_cast<const char *> (&m_blockSamples), sizeof (m_blockSamples));
+    }
+
+  m_async = async;
+  m_open = true;
+  m_buffer.clear ();
+  m_buffer.reserve (m_blockSamples);
+  m_pending.clear ();
+  m_pending.reserve (m_blockSamples);
+  m_hasPending = false;
+  m_stop = false;
+  if (m_async)
+    {
+      m_thread = std::thread (&PiTraceWriter::FlushLoop, this);
+    }
+  return true;
+}
+
+bool
+PiTraceWriter::Close (void)
+{
+  if (!m_open)
+    {
+      return true;
+    }
+  if (!m_buffer.empty ())
+    {
+      Submit ();
+    }
+  if (m_async)
+    {
+      {
+        std::lock_guard<std::mutex> lock (m_mutex);
+        m_stop = true;
+      }
+      m_cv.notify_all ();
+      m_thread.join ();
+    }
+  m_file.flush ();
+  bool ok = m_file.good ();
+  m_file.close ();
+  m_open = false;
+  return ok;
+}
+
+bool
+PiTraceWriter::IsOpen (void) const
+{
+  return m_open;
+}
+
+void
+PiTraceWriter::Submit (void)
+{
+  if (!m_open)
+    {
+      m_buffer.clear ();
+      return;
+    }
+  if (!m_async)
+    {
+      WriteBlock (m_buffer);
+      m_buffer.clear ();
+      return;
+    }
+
+  // Wait until the previous block is written, then swap buffers: the
+  // emptied one comes back with its capacity, so nothing is allocated
+  std::unique_lock<std::mutex> lock (m_mutex);
+  m_cv.wait (lock, [this] { return !m_hasPending; });
+  m_pending.swap (m_buffer);
+  m_hasPending = true;
+  lock.unlock ();
+  m_cv.notify_all ();
+}
+
+void
+PiTraceWriter::FlushLoop (void)
+{
+  std::unique_lock<std::mutex> lock (m_mutex);
+  while (true)
+    {
+      m_cv.wait (lock, [this] { return m_hasPending || m_stop; });
+      if (!m_hasPending)
+        {
+          return;
+        }
+      // m_pending is not touched by the writer while m_hasPending is set
+      lock.unlock ();
+      WriteBlock (m_pending);
+      m_pending.clear ();
+      lock.lock ();
+      m_hasPending = false;
+      m_cv.notify_all ();
+    }
+}
+
+void
+PiTraceWriter::WriteBlock (const std::vector<Sample> &block)
+{
+  if (m_format == TEXT)
+    {
+      WriteText (m_file, block);
+      return;
+    }
+
+  uint32_t n = block.size ();
+  m_file.write (reinterpret_cast<const char *> (&n), sizeof (n));
+  std::vector<double> column (n);
+  double Sample::*fields[] = {&Sample::time, &Sample::qlen, &Sample::avg, &Sample::p};
+  for (double Sample::*field : fields)
+    {
+      for (uint32_t i = 0; i < n; i++)
+        {
+          column[i] = block[i].*field;
+        }
+      m_file.write (reinterpret_cast<const char *> (column.data ()), n * sizeof (double));
+    }
+  std::vector<uint64_t> drops (n);
+  for (uint32_t i = 0; i < n; i++)
+    {
+      drops[i] = block[i].drops;
+    }
+  m_file.write (reinterpret_cast<const char *> (drops.data ()), n * sizeof (uint64_t));
+}
+
+void
+PiTraceWriter::WriteText (std::ostream &os, const std::vector<Sample> &block)
+{
+  // %g is what operator<< prints with the default precision of 6, at a
+  // fraction of the cost
+  char line[160];
+  for (const Sample &s : block)
+    {
+      int n = std::snprintf (line, sizeof (line), "%g %g %g %g %llu\n", s.time, s.qlen, s.avg, s.p,
+                             static_cast<unsigned long long> (s.drops));
+      os.write (line, n);
+    }
+}
+
+bool
+PiTraceWriter::ReadHeader (std::istream &is, uint32_t &maxBlock)
+{
+  char magic[sizeof (PI_TRACE_MAGIC)];
+  is.read (magic, sizeof (magic));
+  if (is.gcount () != sizeof (magic))
+    {
+      return false;
+    }
+  if (std::memcmp (magic, PI_TRACE_MAGIC_V1, sizeof (magic)) == 0)
+    {
+      maxBlock = MAX_BLOCK_SAMPLES;
+      return true;
+    }
+  return std::memcmp (magic, PI_TRACE_MAGIC, sizeof (magic)) == 0
+    && is.read (reinterpret_cast<char *> (&maxBlock), sizeof (maxBlock))
+    && maxBlock > 0 && maxBlock <= MAX_BLOCK_SAMPLES;
+}
+
+bool
+PiTraceWriter::ReadBlock (std::istream &is, std::vector<Sample> &block, uint32_t maxBlock)
+{
+  uint32_t n;
+  if (!is.read (reinterpret_cast<char *> (&n), sizeof (n)))
+    {
+      if (is.gcount () != 0)
+        {
+          is.setstate (std::ios::badbit);
+        }
+      return false;
+    }
+  if (n > maxBlock)
+    {
+      // Corrupt count: nothing is allocated for it
+      is.setstate (std::ios::failbit);
+      return false;
+    }
+
+  block.resize (n);
+  std::vector<double> column (n);
+  double Sample::*fields[] = {&Sample::time, &Sample::qlen, &Sample::avg, &Sample::p};
+  for (double Sample::*field : fields)
+    {
+      if (!is.read (reinterpret_cast<char *> (column.data ()), n * sizeof (double)))
+        {
+          is.setstate (std::ios::badbit);
+          return false;
+        }
+      for (uint32_t i = 0; i < n; i++)
+        {
+          block[i].*field = column[i];
+        }
+    }
+  std::vector<uint64_t> drops (n);
+  if (!is.read (reinterpret_cast<char *> (drops.data ()), n * sizeof (uint64_t)))
+    {
+      is.setstate (std::ios::badbit);
+      return false;
+    }
+  for (uint32_t i = 0; i < n; i++)
+    {
+      block[i].drops = drops[i];
+    }
+  return true;
+}
+
+} //namespace ns3
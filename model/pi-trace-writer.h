@@ -0,0 +1,172 @@
+#ifndef PI_TRACE_WRITER_H
+#define PI_TRACE_WRITER_H
+
+#include <condition_variable>
+#include <fstream>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \ingroup traffic-control
+ *
+ * \brief Buffered writer of periodic queue samples
+ *
+ * Samples are kept in memory and written a block at a time, so sampling
+ * every millisecond costs a few stores per sample instead of a file open
+ * and close. With asynchronous flushing a full block is handed to a
+ * background thread and the caller only waits if that thread is still
+ * busy with the previous block.
+ *
+ * The text format is the .plotme layout of the traffic scripts: one line
+ * per sample with time, queue length and mean queue length, followed by
+ * the drop probability and the number of drops. The binary format starts
+ * with the 8 bytes "PITRACE2" and the largest block size as a uint32_t,
+ * and holds blocks of columns in host byte order: a uint32_t count n, then
+ * n times, n queue lengths, n mean queue lengths and n probabilities as
+ * doubles, and n drop counts as uint64_t. Readers reject a count above the
+ * size in the header, so a corrupt trace cannot make them allocate more
+ * than one block. "PITRACE1" traces, without the size, are still read,
+ * with MAX_BLOCK_SAMPLES as the bound.
+ *
+ * No simulator types are used, so tools can read and convert the binary
+ * format without ns-3.
+ */
+class PiTraceWriter
+{
+public:
+  /// Output format
+  enum Format
+  {
+    TEXT,                                       //!< .plotme text lines
+    BINARY                                      //!< Blocks of binary columns
+  };
+
+  /// Largest number of samples per block
+  static const uint32_t MAX_BLOCK_SAMPLES = 1 << 20;
+
+  /// One sample
+  struct Sample
+  {
+    double time;                                //!< Time in seconds
+    double qlen;                                //!< Queue length
+    double avg;                                 //!< Mean queue length so far
+    double p;                                   //!< Drop probability
+    uint64_t drops;                             //!< Drops so far
+  };
+
+  /**
+   * \brief PiTraceWriter Constructor
+   */
+  PiTraceWriter ();
+
+  /**
+   * \brief Destructor, closes the file
+   */
+  ~PiTraceWriter ();
+
+  /**
+   * \brief Create or truncate the output file
+   * \param fileName file name
+   * \param format output format
+   * \param blockSamples number of samples buffered before a block is
+   *        written, from 1 to MAX_BLOCK_SAMPLES
+   * \param async true to write blocks from a background thread
+   * \returns False if the file cannot be opened.
+   */
+  bool Open (const std::string &fileName, Format format, uint32_t blockSamples = 65536, bool async = true);
+
+  /**
+   * \brief Append a sample
+   * \param time time in seconds
+   * \param qlen queue length
+   * \param avg mean queue length so far
+   * \param p drop probability
+   * \param drops drops so far
+   */
+  void Write (double time, double qlen, double avg, double p, uint64_t drops)
+  {
+    m_buffer.push_back (Sample {time, qlen, avg, p, drops});
+    if (m_buffer.size () >= m_blockSamples)
+      {
+        Submit ();
+      }
+  }
+
+  /**
+   * \brief Write the buffered samples and close the file
+   * \returns False if any write failed.
+   */
+  bool Close (void);
+
+  /**
+   * \returns True between Open and Close.
+   */
+  bool IsOpen (void) const;
+
+  /**
+   * \brief Check the header of a binary trace
+   * \param is input stream at the start of the trace
+   * \param maxBlock the largest block size of the trace
+   * \returns False if the stream does not hold a binary trace.
+   */
+  static bool ReadHeader (std::istream &is, uint32_t &maxBlock);
+
+  /**
+   * \brief Read the next block of a binary trace
+   * \param is input stream after the header or a previous block
+   * \param block the samples of the block
+   * \param maxBlock the largest block size, from ReadHeader
+   * \returns False at the end of the trace (eofbit set), on a truncated
+   *          block (badbit set) or on a count above maxBlock (failbit
+   *          set, eofbit not).
+   */
+  static bool ReadBlock (std::istream &is, std::vector<Sample> &block, uint32_t maxBlock);
+
+  /**
+   * \brief Write samples in the text format
+   * \param os output stream
+   * \param block samples
+   */
+  static void WriteText (std::ostream &os, const std::vector<Sample> &block);
+
+private:
+  /**
+   * \brief Pass the buffered samples to the file or the background thread
+   */
+  void Submit (void);
+
+  /**
+   * \brief Write one block in the format of the file
+   * \param block samples
+   */
+  void WriteBlock (const std::vector<Sample> &block);
+
+  /**
+   * \brief Body of the background thread
+   */
+  void FlushLoop (void);
+
+  std::ofstream m_file;                         //!< Output file
+  Format m_format;                              //!< Output format
+  uint32_t m_blockSamples;                      //!< Samples per block
+  bool m_async;                                 //!< Write from the background thread
+  bool m_open;                                  //!< File is open
+  std::vector<Sample> m_buffer;                 //!< Samples being collected
+  std::vector<Sample> m_pending;                //!< Block waiting for the background thread
+  bool m_hasPending;                            //!< m_pending holds a block
+  bool m_stop;                                  //!< Background thread must exit
+  std::thread m_thread;                         //!< Background thread
+  std::mutex m_mutex;                           //!< Guards m_pending, m_hasPending and m_stop
+  std::condition_variable m_cv;                 //!< Signals changes of m_hasPending and m_stop
+};
+
+};   // namespace ns3
+
+#endif
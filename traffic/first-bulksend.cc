@@ -25,7 +25,12 @@
 #include "ns3/flow-monitor-module.h"
 #include "ns3/tcp-header.h"
 #include "ns3/traffic-control-module.h"
+#include "pi-flow-stats.h"
+#include "pi-options.h"
+#include "pi-window-stats.h"
+#include <chrono>
 #include  <string>
+#include <sys/resource.h>
 
 using namespace ns3;
 using namespace std;
@@ -34,6 +39,10 @@ NS_LOG_COMPONENT_DEFINE ("PiTests");
 
 // Файл для записи результатов
 stringstream filePlotQueue;
+// Выборки очереди копятся в памяти и пишутся на диск блоками в отдельном потоке
+PiTraceWriter queueTrace;
+// Период опроса очереди
+Time queueSamplePeriod;
 // Переменная для подсчета количества вызовов CheckQueueSize
 uint32_t checkTimes = 0;
 // Переменная для хранения суммарного значения всей длины очереди
@@ -43,19 +52,34 @@ double avgQueueDiscSize = 0;
 void CheckQueueSize (Ptr<QueueDisc> queue)
 {
 	// Запись размера очереди в переменную
-	uint32_t qSize = StaticCast<PiQueueDisc> (queue)->GetQueueSize ();
+	Ptr<PiQueueDisc> pi = StaticCast<PiQueueDisc> (queue);
+	uint32_t qSize = pi->GetQueueSize ();
 
 	// Изменяем глобальные переменные для нахождения среднего размера очереди
 	avgQueueDiscSize += qSize;
 	checkTimes++;
 
-	// Вызываем данный метод через 0.1 секунду 
-	Simulator::Schedule (Seconds (0.1), &CheckQueueSize, queue);
+	// Вызываем данный метод через заданный период
+	Simulator::Schedule (queueSamplePeriod, &CheckQueueSize, queue);
 
-	// Запись в файл размера очереди и среднего размера очереди
-	ofstream fPlotQueue (filePlotQueue.str ().c_str (), ios::out | ios::app);
-	fPlotQueue << Simulator::Now ().GetSeconds () << " " << qSize << " " << avgQueueDiscSize / checkTimes << endl;
-	fPlotQueue.close ();
+	// Запись размера очереди, среднего размера очереди, вероятности сброса и количества сбросов
+	queueTrace.Write (Simulator::Now ().GetSeconds (), qSize, avgQueueDiscSize / checkTimes, pi->GetDropProbability (), pi->GetDropCount ());
+}
+
+// Файлы для записи изменений вероятности сброса и времени пребывания в очереди
+ofstream fTraceProb;
+ofstream fTraceDelay;
+
+// Вызывается при каждом изменении вероятности сброса в PI
+void ProbabilityTrace (double oldValue, double newValue)
+{
+	fTraceProb << Simulator::Now ().GetSeconds () << " " << newValue << "\n";
+}
+
+// Вызывается, когда у пакета, покинувшего очередь PI, время пребывания отличается от предыдущего
+void QueueDelayTrace (Time oldValue, Time newValue)
+{
+	fTraceDelay << Simulator::Now ().GetSeconds () << " " << newValue.GetSeconds () << "\n";
 }
 
 int main (int argc, char *argv[])
@@ -72,6 +96,18 @@ int main (int argc, char *argv[])
 	string pathOut = ".";
 	// Запись данных очереди в файл
 	bool writeForPlot = true;
+	// Период опроса очереди для записи
+	string sampleInterval = "100ms";
+	// Запись выборок очереди в двоичном виде (.pitrace), в .plotme переводит tools/pi-trace-convert
+	bool binaryTrace = false;
+	// Запись каждого изменения вероятности сброса и задержки в очереди
+	bool writeTraces = false;
+	// Статистика по потокам из FlowMonitor: скорость, задержка, потери, индекс Джайна
+	bool writeFlowMonitor = false;
+	// Наблюдать каждый flowSample-й источник
+	uint32_t flowSample = 1;
+	// Длина окон, за которые выводятся сбросы и пропускная способность, в секундах
+	double reportWindow = 5;
 
 	// Параметры уязвимого места
 	string bottleneckBandwidth = "10Mbps";
@@ -82,18 +118,7 @@ int main (int argc, char *argv[])
 	string accessDelay = "5ms";
 
 	// Параметры алгоритма PI
-	// Средний размер одного пакета
-	uint32_t meanPktSize = 1000;		// В байтах
-	//
-	string piMode = "QUEUE_MODE_PACKETS";
-	// Желаемый размер очереди для PI
-	uint32_t piQueueRef = 50;
-	// Предел очереди
-	uint32_t piQueueLimit = 200;
-	// А параметр (unused)
-	//uint32_t A = 0.00007288;
-	// B параметр (unused)
-	//uint32_t B = 0.00007264;
+	PiOptions piOptions;
 
 	string tcpType = "TcpNewReno";
 
@@ -101,8 +126,22 @@ int main (int argc, char *argv[])
 	CommandLine cmd;
 	cmd.AddValue ("pathOut", "Path to save results", pathOut);
 	cmd.AddValue ("writeForPlot", "<0/1> to write results for plot (gnuplot)", writeForPlot);
+	cmd.AddValue ("sampleInterval", "Queue sampling period for --writeForPlot, e.g. 1ms", sampleInterval);
+	cmd.AddValue ("binaryTrace", "<0/1> to write queue samples as a binary .pitrace file instead of .plotme text", binaryTrace);
+	cmd.AddValue ("writeTraces", "<0/1> to write every change of PI drop probability and queue delay", writeTraces);
+	cmd.AddValue ("writeFlowMonitor", "<0/1> to write per-flow goodput, delay, RTT and loss and Jain's fairness index at the end of the run", writeFlowMonitor);
+	cmd.AddValue ("flowSample", "With --writeFlowMonitor, monitor every flowSample-th source only", flowSample);
+	cmd.AddValue ("reportWindow", "Seconds after the start over which PI drops and throughput are reported", reportWindow);
+	cmd.AddValue ("simDuration", "Simulation time in seconds", simDuration);
+	cmd.AddValue ("bottleneckBandwidth", "Bottleneck link data rate", bottleneckBandwidth);
+	cmd.AddValue ("bottleneckDelay", "Bottleneck link delay", bottleneckDelay);
+	cmd.AddValue ("accessBandwidth", "Access link data rate", accessBandwidth);
+	cmd.AddValue ("accessDelay", "Access link delay", accessDelay);
+	piOptions.Register (cmd);
 	cmd.AddValue ("tcpType", "Types of TCP, default TcpNewReno", tcpType);
 	cmd.Parse (argc,argv);
+	queueSamplePeriod = Time (sampleInterval);
+	stopTime = startTime + simDuration;
 
 	LogComponentEnable ("PiQueueDisc", LOG_LEVEL_INFO);
 
@@ -126,24 +165,19 @@ int main (int argc, char *argv[])
 	// Выключение алгоритма ограничения передачи
 	Config::SetDefault ("ns3::TcpSocketBase::LimitedTransmit", BooleanValue (false));
 	// Максимальный размер сегмента TCP в байтах (может быть скорректирован в зависимости от оббнаружения MTU)
-	Config::SetDefault ("ns3::TcpSocket::SegmentSize", UintegerValue (meanPktSize));
+	Config::SetDefault ("ns3::TcpSocket::SegmentSize", UintegerValue (piOptions.meanPktSize));
 	// Включение возможности TCP window scale (параметр для увеличения размера окна приема)
 	Config::SetDefault ("ns3::TcpSocketBase::WindowScaling", BooleanValue (true));
+	// Поддержка ECN на стороне TCP
+	Config::SetDefault ("ns3::TcpSocketBase::UseEcn", StringValue (piOptions.useEcn ? "On" : "Off"));
 
-	// Настройка параметров PI алгоритма
-	// Средний размер пакета
-	Config::SetDefault ("ns3::PiQueueDisc::MeanPktSize", UintegerValue (meanPktSize));
-	// Режим работы (В данном случае с пакетами)
-	Config::SetDefault ("ns3::PiQueueDisc::Mode", StringValue (piMode));
-	// Желаемый размер очереди
-	Config::SetDefault ("ns3::PiQueueDisc::QueueRef", DoubleValue (piQueueRef));
-	// Предел очереди
-	Config::SetDefault ("ns3::PiQueueDisc::QueueLimit", DoubleValue (piQueueLimit));
+	// Настройка параметров PI алгоритма; файл гистограмм - для --writeHistogram
+	stringstream fileHist;
+	fileHist << pathOut << "/" << "pi-hist1-" << tcpType << ".txt";
+	// Время распространения туда и обратно для автонастройки A и B
+	piOptions.Apply (2 * (2 * Time (accessDelay).GetSeconds () + Time (bottleneckDelay).GetSeconds ()), fileHist.str ());
 
 	Config::SetDefault("ns3::TcpL4Protocol::SocketType", StringValue("ns3::" + tcpType));
-	// Возможность изменить параметры в расчете p
-	// Config::SetDefault ("ns3::PiQueueDisc::A", DoubleValue (A));
-	// Config::SetDefault ("ns3::PiQueueDisc::B", DoubleValue (B));
 
 	NS_LOG_INFO ("Install internet stack on all nodes.");
 	// Даёт возможность узлам использовать протоколы ip/tcp/udp
@@ -190,6 +224,12 @@ int main (int argc, char *argv[])
 	devices_gateway = bottleneckLink.Install (gateway.Get (0), gateway.Get (1));
 	// Только здесь используется PI алгоритма
 	QueueDiscContainer queueDiscs = tchPi.Install (devices_gateway);
+	// Фиксируем потоки случайных чисел PI: при одном и том же --RngRun
+	// результат повторяется, при разных запуски независимы
+	int64_t stream = 0;
+	for (uint32_t i = 0; i < queueDiscs.GetN (); i++) {
+		stream += StaticCast<PiQueueDisc> (queueDiscs.Get (i))->AssignStreams (stream);
+	}
 
 	NS_LOG_INFO ("Assign IP Addresses");
 	// Указываем адрес всей сети (с маской)
@@ -231,7 +271,7 @@ int main (int argc, char *argv[])
 		// Адрес приёмника
 		ftp.SetAttribute ("Remote", remoteAddress);
 		// размер данных которые отпарвляются каждый раз
-		ftp.SetAttribute ("SendSize", UintegerValue (meanPktSize));
+		ftp.SetAttribute ("SendSize", UintegerValue (piOptions.meanPktSize));
 
 		// Установка ftp на узлы и запуск установка параметров запуска и окончания работы
 		ApplicationContainer sourceApp = ftp.Install (source.Get (i));
@@ -246,23 +286,70 @@ int main (int argc, char *argv[])
 
 	// Запись в файл данных очереди
 	if (writeForPlot) {
-		filePlotQueue << pathOut << "/" << "pi-queue1-" << tcpType << ".plotme";
-		remove (filePlotQueue.str ().c_str ());
+		filePlotQueue << pathOut << "/" << "pi-queue1-" << tcpType << (binaryTrace ? ".pitrace" : ".plotme");
+		bool opened = queueTrace.Open (filePlotQueue.str (), binaryTrace ? PiTraceWriter::BINARY : PiTraceWriter::TEXT);
+		NS_ABORT_MSG_IF (!opened, "Cannot open " << filePlotQueue.str ());
 		Ptr<QueueDisc> queue = queueDiscs.Get (0);
 		Simulator::ScheduleNow (&CheckQueueSize, queue);
 	}
 
+	// Запись изменений по трассам PI, без периодического опроса
+	if (writeTraces) {
+		stringstream fileProb, fileDelay;
+		fileProb << pathOut << "/" << "pi-prob1-" << tcpType << ".plotme";
+		fileDelay << pathOut << "/" << "pi-delay1-" << tcpType << ".plotme";
+		fTraceProb.open (fileProb.str ().c_str (), ios::out | ios::trunc);
+		fTraceDelay.open (fileDelay.str ().c_str (), ios::out | ios::trunc);
+		queueDiscs.Get (0)->TraceConnectWithoutContext ("Probability", MakeCallback (&ProbabilityTrace));
+		queueDiscs.Get (0)->TraceConnectWithoutContext ("QueueDelay", MakeCallback (&QueueDelayTrace));
+	}
+
+	// Мониторы потоков ставятся после выдачи адресов
+	PiFlowStats flowStats;
+	if (writeFlowMonitor) {
+		flowStats.Install (source, sink, flowSample);
+	}
+
+	// Сбросы и пропускная способность на старте
+	PiWindowStats windowStats;
+	windowStats.Add (StaticCast<PiQueueDisc> (queueDiscs.Get (0)), "startup", startTime, reportWindow);
+
 	// Запуск симуляции
+	auto runStart = chrono::steady_clock::now ();
 	Simulator::Stop (Seconds (stopTime));
 	Simulator::Run ();
+	double runSeconds = chrono::duration<double> (chrono::steady_clock::now () - runStart).count ();
+	// Дописываем оставшиеся в буфере выборки очереди
+	queueTrace.Close ();
 
 	// Вывод информации о выкинутых пакетах
 	if (printPiStats) {
-		PiQueueDisc::Stats st = StaticCast<PiQueueDisc> (queueDiscs.Get (0))->GetStats ();
-		cout << "*** pi stats from bottleneck queue ***" << endl;
-		cout << "\t " << st.unforcedDrop << " drops due to probability " << endl;
-		cout << "\t " << st.forcedDrop << " drops due queue full" << endl;
+		piOptions.PrintStats (cout, queueDiscs.Get (0));
+	}
+
+	// Итоги по потокам дописываются в строку PI-SUMMARY
+	stringstream flowSummary;
+	if (writeFlowMonitor) {
+		stringstream fileFlows;
+		fileFlows << pathOut << "/" << "pi-flows1-" << tcpType << ".txt";
+		bool written = flowStats.Write (fileFlows.str (), flowSummary);
+		NS_ABORT_MSG_IF (!written, "Cannot write " << fileFlows.str ());
+	}
+
+	// Итоговая строка в виде ключ=значение, её собирает pi-sweep
+	cout << "PI-SUMMARY";
+	if (checkTimes > 0) {
+		cout << " meanQueue=" << avgQueueDiscSize / checkTimes;
 	}
+	piOptions.WriteSummary (cout, queueDiscs.Get (0));
+	windowStats.Write (cout);
+
+	// Производительность: события, время цикла моделирования, наибольшая память
+	struct rusage usage;
+	getrusage (RUSAGE_SELF, &usage);
+	cout << " enqueues=" << queueDiscs.Get (0)->GetStats ().nTotalReceivedPackets << " events=" << Simulator::GetEventCount ()
+	     << " runSeconds=" << runSeconds << " peakRssKb=" << usage.ru_maxrss;
+	cout << flowSummary.str () << endl;
 
 	Simulator::Destroy ();
 	return 0;
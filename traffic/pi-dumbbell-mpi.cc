@@ -0,0 +1,512 @@
+/*
+ * Distributed (MPI) variant of pi-dumbbell for runs with many thousands of
+ * sources. The topology and the options are those of pi-dumbbell; the
+ * nodes are split between MPI ranks and each rank simulates its own part:
+ *   rank 0 - gateway0 with the PI queue of the bottleneck and the sources,
+ *   rank 1 - gateway1 and the sink.
+ * The cut is on the bottleneck link, so its delay (50 ms by default) is the
+ * lookahead: the ranks only synchronize once per bottleneckDelay of
+ * simulated time. With more than 2 ranks the sources are split evenly
+ * between rank 0 and ranks 2..N-1; their access links to gateway0 are cut
+ * as well and the lookahead drops to the smallest access delay.
+ *
+ * ns-3 has to be configured with --enable-mpi; on one Linux box:
+ *   ./ns3 run pi-dumbbell-mpi --command-template="mpirun -np 2 %s --tcpSources=10000"
+ * Rank 0 prints the statistics and the PI-SUMMARY line, with runSeconds
+ * to compare with the sequential pi-dumbbell ("make dumbbell-mpi" in
+ * autoscripts runs both and prints the speedup).
+*/
+
+/* Network topology
+ *
+ *         accessBandwidth, accessDelay    bottleneckBandwidth, bottleneckDelay    accessBandwidth, accessDelay
+ *   (TCP and UDP sources)-------------(gateway0)------------------(gateway1)-------------(sink)
+ *                                   rank 0     QueueLimit = queueLimit    rank 1
+ *
+*/
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/traffic-control-module.h"
+#ifdef NS3_MPI
+#include "ns3/mpi-interface.h"
+#include <mpi.h>
+#endif
+#include "pi-dumbbell.h"
+#include "pi-options.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+using namespace std;
+
+NS_LOG_COMPONENT_DEFINE ("PiDumbbellMpi");
+
+#ifdef NS3_MPI
+
+// Файл для записи результатов
+stringstream filePlotQueue;
+// Выборки очереди копятся в памяти и пишутся на диск блоками в отдельном потоке
+PiTraceWriter queueTrace;
+// Период опроса очереди
+Time queueSamplePeriod;
+// Переменная для подсчета количества вызовов CheckQueueSize
+uint32_t checkTimes = 0;
+// Переменная для хранения суммарного значения всей длины очереди
+double avgQueueDiscSize = 0;
+
+// Метод для вывода размера очереди и среднего значентия очереди в отдельный файл
+void CheckQueueSize (Ptr<QueueDisc> queue)
+{
+	// Запись размера очереди в переменную
+	// FqPiQueueDisc считает очередь только в пакетах
+	Ptr<PiQueueDisc> pi = DynamicCast<PiQueueDisc> (queue);
+	uint32_t qSize = pi ? pi->GetQueueSize () : queue->GetNPackets ();
+
+	// Изменяем глобальные переменные для нахождения среднего размера очереди
+	avgQueueDiscSize += qSize;
+	checkTimes++;
+
+	// Вызываем данный метод через заданный период
+	Simulator::Schedule (queueSamplePeriod, &CheckQueueSize, queue);
+
+	// Запись размера очереди, среднего размера очереди, вероятности сброса и количества сбросов;
+	// у FqPiQueueDisc вероятность своя в каждой корзине, поэтому пишется 0
+	double p = pi ? pi->GetDropProbability () : 0;
+	uint64_t drops = pi ? pi->GetDropCount () : queue->GetStats ().nTotalDroppedPackets;
+	queueTrace.Write (Simulator::Now ().GetSeconds (), qSize, avgQueueDiscSize / checkTimes, p, drops);
+}
+
+// Файлы для записи изменений вероятности сброса и времени пребывания в очереди
+ofstream fTraceProb;
+ofstream fTraceDelay;
+
+// Вызывается при каждом изменении вероятности сброса в PI
+void ProbabilityTrace (double oldValue, double newValue)
+{
+	fTraceProb << Simulator::Now ().GetSeconds () << " " << newValue << "\n";
+}
+
+// Вызывается, когда у пакета, покинувшего очередь PI, время пребывания отличается от предыдущего
+void QueueDelayTrace (Time oldValue, Time newValue)
+{
+	fTraceDelay << Simulator::Now ().GetSeconds () << " " << newValue.GetSeconds () << "\n";
+}
+
+// Ранг источника index из nSources: при 2 рангах все источники на ранге 0,
+// иначе подряд идущими блоками на рангах 0, 2, 3, ..., size - 1
+uint32_t SourceRank (uint32_t index, uint32_t nSources, uint32_t size)
+{
+	uint32_t blocks = size - 1;
+	uint32_t block = (uint64_t) index * blocks / nSources;
+	return block == 0 ? 0 : block + 1;
+}
+
+int main (int argc, char *argv[])
+{
+	auto setupStart = chrono::steady_clock::now ();
+
+	// Вывод статистики
+	bool printPiStats = true;
+	// Время начала симуляции
+	float startTime = 0.0;		// в секундах
+	// Длительность симуляции
+	float simDuration = 101;	// в секундах
+	// Время окончания симуляции
+	float stopTime = startTime + simDuration;		// в секундах
+	// Интервал, на который равномерно разносятся запуски источников
+	float startSpread = 0;		// в секундах
+	// Синхронизация нулевыми сообщениями вместо общих барьеров
+	bool nullMessage = false;
+	// Каталог для записи выводимых файлов
+	string pathOut = ".";
+	// Файл с параметрами вида "имя значение"
+	string configFile;
+	// Запись данных очереди в файл
+	bool writeForPlot = true;
+	// Период опроса очереди для записи
+	string sampleInterval = "100ms";
+	// Запись выборок очереди в двоичном виде (.pitrace), в .plotme переводит tools/pi-trace-convert
+	bool binaryTrace = false;
+	// Запись каждого изменения вероятности сброса и задержки в очереди
+	bool writeTraces = false;
+	// Алгоритм на узком месте: ns3::PiQueueDisc или ns3::FqPiQueueDisc
+	string queueDiscType = "ns3::PiQueueDisc";
+
+	// Источники, если группы не заданы явно
+	uint32_t tcpSources = 5;
+	uint32_t udpSources = 0;
+	// Варианты TCP с весами
+	string tcpMix = "TcpNewReno";
+	// Скорость каждого источника UDP
+	string udpRate = "10Mbps";
+	// Группы источников: "количество тип скорость задержка [скорость UDP]" через ;
+	string groupsText;
+	// Файл с группами источников, по одной в строке
+	string groupsFile;
+	// Маршрутизация: global или static
+	string routing = "global";
+
+	// Параметры уязвимого места
+	string bottleneckBandwidth = "10Mbps";
+	string bottleneckDelay = "50ms";
+
+	// Параметры всей остальной сети (и канала до приёмника)
+	string accessBandwidth = "10Mbps";
+	string accessDelay = "5ms";
+
+	// Параметры алгоритма PI
+	PiOptions piOptions;
+
+	// Возможность менять параметры из консоли
+	CommandLine cmd;
+	cmd.AddValue ("config", "File with one \"name value\" option per line, overridden by the command line", configFile);
+	cmd.AddValue ("nullMessage", "<0/1> to synchronize the ranks with null messages instead of global barriers", nullMessage);
+	cmd.AddValue ("pathOut", "Path to save results", pathOut);
+	cmd.AddValue ("writeForPlot", "<0/1> to write results for plot (gnuplot)", writeForPlot);
+	cmd.AddValue ("sampleInterval", "Queue sampling period for --writeForPlot, e.g. 1ms", sampleInterval);
+	cmd.AddValue ("binaryTrace", "<0/1> to write queue samples as a binary .pitrace file instead of .plotme text", binaryTrace);
+	cmd.AddValue ("writeTraces", "<0/1> to write every change of PI drop probability and queue delay (ns3::PiQueueDisc only)", writeTraces);
+	cmd.AddValue ("queueDiscType", "Bottleneck queue disc: ns3::PiQueueDisc or ns3::FqPiQueueDisc", queueDiscType);
+	cmd.AddValue ("simDuration", "Simulation time in seconds", simDuration);
+	cmd.AddValue ("startSpread", "Seconds over which the source start times are spread evenly", startSpread);
+	cmd.AddValue ("tcpSources", "Number of TCP sources, unless --groups or --groupsFile is given", tcpSources);
+	cmd.AddValue ("udpSources", "Number of UDP sources, unless --groups or --groupsFile is given", udpSources);
+	cmd.AddValue ("tcpMix", "TCP variants of the TCP sources with weights, e.g. TcpCubic:3,TcpNewReno:1", tcpMix);
+	cmd.AddValue ("udpRate", "Data rate of each UDP source", udpRate);
+	cmd.AddValue ("groups", "Source groups \"count type bandwidth delay [udpRate]\" separated by ';', type is a TCP variant or udp", groupsText);
+	cmd.AddValue ("groupsFile", "File with one source group per line, as in --groups", groupsFile);
+	cmd.AddValue ("routing", "Routing: global (Ipv4GlobalRoutingHelper) or static (default routes)", routing);
+	cmd.AddValue ("bottleneckBandwidth", "Bottleneck link data rate", bottleneckBandwidth);
+	cmd.AddValue ("bottleneckDelay", "Bottleneck link delay, the lookahead of the ranks", bottleneckDelay);
+	cmd.AddValue ("accessBandwidth", "Access link data rate of the sources and the sink", accessBandwidth);
+	cmd.AddValue ("accessDelay", "Access link delay of the sources and the sink", accessDelay);
+	piOptions.Register (cmd, false);
+
+	// Параметры из файла ставятся перед параметрами командной строки,
+	// поэтому командная строка их переопределяет
+	cmd.Parse (ArgsWithConfig (argc, argv));
+	queueSamplePeriod = Time (sampleInterval);
+	stopTime = startTime + simDuration;
+
+	// Распределённый планировщик; MPI включается до создания узлов
+	GlobalValue::Bind ("SimulatorImplementationType",
+	                   StringValue (nullMessage ? "ns3::NullMessageSimulatorImpl" : "ns3::DistributedSimulatorImpl"));
+	MpiInterface::Enable (&argc, &argv);
+	uint32_t systemId = MpiInterface::GetSystemId ();
+	uint32_t systemCount = MpiInterface::GetSize ();
+	if (systemCount < 2) {
+		cerr << "pi-dumbbell-mpi needs at least 2 ranks (mpirun -np 2); use pi-dumbbell for one" << endl;
+		MpiInterface::Disable ();
+		return 1;
+	}
+
+	// Группы источников: явные или из tcpSources, tcpMix и udpSources
+	vector<SourceGroup> groups = BuildGroups (groupsText, groupsFile, tcpSources, tcpMix, udpSources, udpRate,
+	                                          accessBandwidth, accessDelay);
+
+	// Проверка вариантов TCP и подсчёт источников
+	uint32_t nSources = 0;
+	uint32_t nTcp = 0;
+	double rttSum = 0;
+	vector<TypeId> tcpTypes (groups.size ());
+	for (size_t g = 0; g < groups.size (); g++) {
+		nSources += groups[g].count;
+		rttSum += groups[g].count * 2 * (Time (groups[g].delay).GetSeconds () + Time (bottleneckDelay).GetSeconds () + Time (accessDelay).GetSeconds ());
+		if (groups[g].type != "udp") {
+			nTcp += groups[g].count;
+			NS_ABORT_MSG_IF (!TypeId::LookupByNameFailSafe ("ns3::" + groups[g].type, &tcpTypes[g]),
+			                 "Unknown TCP variant " << groups[g].type);
+		}
+	}
+	NS_ABORT_MSG_IF (nSources == 0, "No sources");
+	// Каждому источнику своя сеть /24 из 10.0.0.0/8, ещё две - шлюзам и приёмнику
+	NS_ABORT_MSG_IF (nSources > 65534, "At most 65534 sources fit in 10.0.0.0/8");
+	// Nix-vector в распределённом моделировании не работает
+	NS_ABORT_MSG_IF (routing != "global" && routing != "static", "Unknown routing " << routing);
+
+	if (systemId == 0) {
+		LogComponentEnable ("PiQueueDisc", LOG_LEVEL_INFO);
+	}
+
+	// Каждый ранг строит всю топологию, но моделирует только свои узлы.
+	// Узлы источников
+	NodeContainer source;
+	for (uint32_t i = 0; i < nSources; i++) {
+		source.Create (1, SourceRank (i, nSources, systemCount));
+	}
+
+	// 2 связующих шлюза: левый с очередью PI на ранге 0, правый на ранге 1
+	NodeContainer gateway;
+	gateway.Create (1, 0);
+	gateway.Create (1, 1);
+
+	// 1 приёмник
+	NodeContainer sink;
+	sink.Create (1, 1);
+
+	Config::SetDefault ("ns3::DropTailQueue<Packet>::MaxSize", StringValue ("13p"));
+	Config::SetDefault ("ns3::PfifoFastQueueDisc::MaxSize", QueueSizeValue (QueueSize ("50p")));
+
+	// Значение времени ожидания для отложенных подтверждений TCP (в секундах)
+	Config::SetDefault ("ns3::TcpSocket::DelAckTimeout", TimeValue(Seconds (0)));
+	// Выключение алгоритма ограничения передачи
+	Config::SetDefault ("ns3::TcpSocketBase::LimitedTransmit", BooleanValue (false));
+	// Максимальный размер сегмента TCP в байтах (может быть скорректирован в зависимости от оббнаружения MTU)
+	Config::SetDefault ("ns3::TcpSocket::SegmentSize", UintegerValue (piOptions.meanPktSize));
+	// Включение возможности TCP window scale (параметр для увеличения размера окна приема)
+	Config::SetDefault ("ns3::TcpSocketBase::WindowScaling", BooleanValue (true));
+	// Поддержка ECN на стороне TCP
+	Config::SetDefault ("ns3::TcpSocketBase::UseEcn", StringValue (piOptions.useEcn ? "On" : "Off"));
+
+	// Настройка параметров PI алгоритма; время распространения туда и обратно
+	// для автонастройки A и B - среднее по источникам
+	piOptions.Apply (rttSum / nSources, "");
+
+	NS_LOG_INFO ("Install internet stack on all nodes.");
+	// Даёт возможность узлам использовать протоколы ip/tcp/udp
+	InternetStackHelper internet;
+	internet.InstallAll ();
+
+	// Настройка pfifo(алгоритм обслуживания очередей работа с пакетами)
+	// С помощью TrafficControlHelper и устанавливаются все QueueDisc протоколы
+	TrafficControlHelper tchPfifo;
+	// Установка основного алгоритма
+	uint16_t handle = tchPfifo.SetRootQueueDisc ("ns3::PfifoFastQueueDisc");
+	// Настраиваем DropTail как алгоритм обработки очереди
+	tchPfifo.AddInternalQueues (handle, 3, "ns3::DropTailQueue", "MaxSize", StringValue ("1000p"));
+
+	// Настройка PI алгоритма на одельный TrafficControlHelper
+	TrafficControlHelper tchPi;
+	tchPi.SetRootQueueDisc (queueDiscType);
+
+	// Настраиваем узкое место сети, которое устанавливаем между двумя шлюзами.
+	// Шлюзы на разных рангах, поэтому канал удалённый и его задержка - lookahead
+	PointToPointHelper bottleneckLink;
+	bottleneckLink.SetQueue ("ns3::DropTailQueue");
+	bottleneckLink.SetDeviceAttribute ("DataRate", StringValue (bottleneckBandwidth));
+	bottleneckLink.SetChannelAttribute ("Delay", StringValue (bottleneckDelay));
+
+	NetDeviceContainer devices_gateway;
+	devices_gateway = bottleneckLink.Install (gateway.Get (0), gateway.Get (1));
+	// Как и в pi-dumbbell, PI на обоих концах; очередь прямого направления,
+	// которую опрашивают и по которой считается статистика, - на ранге 0
+	QueueDiscContainer queueDiscs = tchPi.Install (devices_gateway);
+	// Фиксируем потоки случайных чисел PI: при одном и том же --RngRun
+	// результат повторяется, при разных запуски независимы
+	int64_t stream = 0;
+	for (uint32_t i = 0; i < queueDiscs.GetN (); i++) {
+		Ptr<PiQueueDisc> piDisc = DynamicCast<PiQueueDisc> (queueDiscs.Get (i));
+		Ptr<FqPiQueueDisc> fqPiDisc = DynamicCast<FqPiQueueDisc> (queueDiscs.Get (i));
+		if (piDisc) {
+			stream += piDisc->AssignStreams (stream);
+		} else if (fqPiDisc) {
+			stream += fqPiDisc->AssignStreams (stream);
+		}
+	}
+
+	// Правый шлюз соединяем с приёмником
+	PointToPointHelper accessLink;
+	accessLink.SetQueue ("ns3::DropTailQueue");
+	accessLink.SetDeviceAttribute ("DataRate", StringValue (accessBandwidth));
+	accessLink.SetChannelAttribute ("Delay", StringValue (accessDelay));
+
+	NetDeviceContainer devices_sink;
+	devices_sink = accessLink.Install (gateway.Get (1), sink.Get (0));
+	tchPfifo.Install (devices_sink);
+
+	NS_LOG_INFO ("Assign IP Addresses");
+	// Указываем адрес всей сети (с маской)
+	Ipv4AddressHelper address;
+	address.SetBase ("10.0.0.0", "255.255.255.0");
+
+	// Выдаём адрес для соединения шлюз-шлюз
+	Ipv4InterfaceContainer interfaces_gateway = address.Assign (devices_gateway);
+
+	// Выдаём адрес для соединения шлюз-приёмник
+	address.NewNetwork ();
+	Ipv4InterfaceContainer interfaces_sink = address.Assign (devices_sink);
+
+	// Приёмники TCP и UDP - только на ранге приёмника
+	uint16_t port = 50000;
+	uint16_t port1 = 50001;
+	if (sink.Get (0)->GetSystemId () == systemId) {
+		Address sinkLocalAddress (InetSocketAddress (Ipv4Address::GetAny (), port));
+		Address sinkLocalAddress1 (InetSocketAddress (Ipv4Address::GetAny (), port1));
+		PacketSinkHelper sinkHelper ("ns3::TcpSocketFactory", sinkLocalAddress);
+		PacketSinkHelper sinkHelper1 ("ns3::UdpSocketFactory", sinkLocalAddress1);
+		ApplicationContainer sinkApp = sinkHelper.Install (sink);
+		sinkApp.Add (sinkHelper1.Install (sink));
+		sinkApp.Start (Seconds (startTime));
+		sinkApp.Stop (Seconds (stopTime));
+	}
+
+	// Адрес приёмника
+	AddressValue remoteAddress (InetSocketAddress (interfaces_sink.GetAddress (1), port));
+	AddressValue remoteAddress1 (InetSocketAddress (interfaces_sink.GetAddress (1), port1));
+
+	// Настраиваем вспомогающие приложения для генерации трафика
+	BulkSendHelper ftp ("ns3::TcpSocketFactory", Address ());
+	ftp.SetAttribute ("Remote", remoteAddress);
+	ftp.SetAttribute ("SendSize", UintegerValue (piOptions.meanPktSize));
+
+	OnOffHelper udpHelper ("ns3::UdpSocketFactory", Address ());
+	udpHelper.SetAttribute ("OnTime", StringValue ("ns3::ConstantRandomVariable[Constant=1]"));
+	udpHelper.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0]"));
+	udpHelper.SetAttribute ("PacketSize", UintegerValue (piOptions.meanPktSize));
+	udpHelper.SetAttribute ("Remote", remoteAddress1);
+
+	// Маршруты по умолчанию для --routing=static: путь к приёмнику и обратно
+	// единственный, поэтому каждому узлу хватает одной записи
+	Ipv4StaticRoutingHelper staticRouting;
+	if (routing == "static") {
+		Ptr<Ipv4> ipv4 = gateway.Get (0)->GetObject<Ipv4> ();
+		staticRouting.GetStaticRouting (ipv4)->SetDefaultRoute (interfaces_gateway.GetAddress (1), ipv4->GetInterfaceForDevice (devices_gateway.Get (0)));
+		ipv4 = gateway.Get (1)->GetObject<Ipv4> ();
+		staticRouting.GetStaticRouting (ipv4)->SetDefaultRoute (interfaces_gateway.GetAddress (0), ipv4->GetInterfaceForDevice (devices_gateway.Get (1)));
+		ipv4 = sink.Get (0)->GetObject<Ipv4> ();
+		staticRouting.GetStaticRouting (ipv4)->SetDefaultRoute (interfaces_sink.GetAddress (0), ipv4->GetInterfaceForDevice (devices_sink.Get (1)));
+	}
+
+	// Источники группа за группой: свой канал до левого шлюза, своя сеть и
+	// приложение на ранге источника. Каналы источников с других рангов
+	// удалённые, их задержка тоже ограничивает lookahead
+	Time lookahead = Time (bottleneckDelay);
+	vector<uint32_t> rankSources (systemCount, 0);
+	uint32_t index = 0;
+	for (size_t g = 0; g < groups.size (); g++) {
+		const SourceGroup &group = groups[g];
+		accessLink.SetDeviceAttribute ("DataRate", StringValue (group.bandwidth));
+		accessLink.SetChannelAttribute ("Delay", StringValue (group.delay));
+		udpHelper.SetAttribute ("DataRate", DataRateValue (DataRate (group.udpRate)));
+
+		for (uint32_t k = 0; k < group.count; k++, index++) {
+			Ptr<Node> node = source.Get (index);
+			NetDeviceContainer devices = accessLink.Install (node, gateway.Get (0));
+			tchPfifo.Install (devices);
+			address.NewNetwork ();
+			Ipv4InterfaceContainer interfaces = address.Assign (devices);
+			if (routing == "static") {
+				staticRouting.GetStaticRouting (node->GetObject<Ipv4> ())->SetDefaultRoute (interfaces.GetAddress (1), 1);
+			}
+
+			rankSources[node->GetSystemId ()]++;
+			if (node->GetSystemId () != gateway.Get (0)->GetSystemId ()) {
+				lookahead = min (lookahead, Time (group.delay));
+			}
+			if (node->GetSystemId () != systemId) {
+				continue;
+			}
+
+			ApplicationContainer sourceApp;
+			if (group.type == "udp") {
+				sourceApp = udpHelper.Install (node);
+			} else {
+				// Вариант TCP задаётся каждому узлу отдельно
+				node->GetObject<TcpL4Protocol> ()->SetAttribute ("SocketType", TypeIdValue (tcpTypes[g]));
+				sourceApp = ftp.Install (node);
+			}
+			sourceApp.Start (Seconds (startTime + startSpread * index / nSources));
+			sourceApp.Stop (Seconds (stopTime - 1));
+		}
+	}
+
+	// Глобальная маршрутизация: каждый ранг строит таблицы всей топологии
+	if (routing == "global") {
+		NS_LOG_INFO ("Initialize Global Routing.");
+		// Создаёт базу данных маршрутизации и инициализирует таблицы маршрутизации узлов в моделировании
+		Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+	}
+
+	// Время на построение топологии и память; наибольшая память - по всем рангам
+	double setupSeconds = chrono::duration<double> (chrono::steady_clock::now () - setupStart).count ();
+	uint64_t rssKb, peakKb, maxPeakKb;
+	GetMemory (rssKb, peakKb);
+	MPI_Reduce (&peakKb, &maxPeakKb, 1, MPI_UINT64_T, MPI_MAX, 0, MPI_COMM_WORLD);
+	if (systemId == 0) {
+		cout << "Setup: " << nSources << " sources (" << nTcp << " TCP, " << nSources - nTcp << " UDP) in "
+		     << groups.size () << " groups, " << routing << " routing, " << systemCount << " ranks: "
+		     << setupSeconds << " s, rank 0 RSS " << rssKb / 1024.0 << " MB, peak of all ranks "
+		     << maxPeakKb / 1024.0 << " MB" << endl;
+		cout << "Partition: lookahead " << lookahead.GetSeconds () << " s, sources per rank";
+		for (uint32_t r = 0; r < systemCount; r++) {
+			cout << " " << rankSources[r];
+		}
+		cout << endl;
+	}
+
+	// Запись в файл данных очереди - там, где моделируется очередь
+	Ptr<QueueDisc> queue = queueDiscs.Get (0);
+	if (systemId == 0 && writeForPlot) {
+		filePlotQueue << pathOut << "/" << "pi-queue-dumbbell-mpi" << (binaryTrace ? ".pitrace" : ".plotme");
+		bool opened = queueTrace.Open (filePlotQueue.str (), binaryTrace ? PiTraceWriter::BINARY : PiTraceWriter::TEXT);
+		NS_ABORT_MSG_IF (!opened, "Cannot open " << filePlotQueue.str ());
+		Simulator::ScheduleNow (&CheckQueueSize, queue);
+	}
+
+	// Запись изменений по трассам PI, без периодического опроса
+	if (systemId == 0 && writeTraces) {
+		stringstream fileProb, fileDelay;
+		fileProb << pathOut << "/" << "pi-prob-dumbbell-mpi.plotme";
+		fileDelay << pathOut << "/" << "pi-delay-dumbbell-mpi.plotme";
+		fTraceProb.open (fileProb.str ().c_str (), ios::out | ios::trunc);
+		fTraceDelay.open (fileDelay.str ().c_str (), ios::out | ios::trunc);
+		// Трасс Probability и QueueDelay нет у FQ-PI: у него вероятность своя у каждой корзины
+		bool connected = queue->TraceConnectWithoutContext ("Probability", MakeCallback (&ProbabilityTrace))
+		                 && queue->TraceConnectWithoutContext ("QueueDelay", MakeCallback (&QueueDelayTrace));
+		NS_ABORT_MSG_IF (!connected, "--writeTraces needs the Probability and QueueDelay traces of ns3::PiQueueDisc, not " << queueDiscType);
+	}
+
+	// Запуск симуляции; ранги ждут друг друга, так что время одно на всех
+	MPI_Barrier (MPI_COMM_WORLD);
+	auto runStart = chrono::steady_clock::now ();
+	Simulator::Stop (Seconds (stopTime));
+	Simulator::Run ();
+	MPI_Barrier (MPI_COMM_WORLD);
+	double runSeconds = chrono::duration<double> (chrono::steady_clock::now () - runStart).count ();
+	// Дописываем оставшиеся в буфере выборки очереди
+	queueTrace.Close ();
+	GetMemory (rssKb, peakKb);
+	MPI_Reduce (&peakKb, &maxPeakKb, 1, MPI_UINT64_T, MPI_MAX, 0, MPI_COMM_WORLD);
+	// События всех рангов
+	uint64_t events = Simulator::GetEventCount ();
+	uint64_t allEvents = 0;
+	MPI_Reduce (&events, &allEvents, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+
+	if (systemId == 0) {
+		// Вывод информации о выкинутых пакетах
+		if (printPiStats) {
+			piOptions.PrintStats (cout, queue);
+		}
+
+		// Итоговая строка в виде ключ=значение, её собирает pi-sweep
+		cout << "PI-SUMMARY sources=" << nSources << " ranks=" << systemCount;
+		if (checkTimes > 0) {
+			cout << " meanQueue=" << avgQueueDiscSize / checkTimes;
+		}
+		piOptions.WriteSummary (cout, queue);
+		cout << " enqueues=" << queue->GetStats ().nTotalReceivedPackets << " events=" << allEvents
+		     << " setupSeconds=" << setupSeconds << " runSeconds=" << runSeconds << " peakRssKb=" << maxPeakKb << endl;
+	}
+
+	Simulator::Destroy ();
+	MpiInterface::Disable ();
+	return 0;
+}
+
+#else
+
+int main (int argc, char *argv[])
+{
+	cerr << "pi-dumbbell-mpi needs ns-3 configured with --enable-mpi" << endl;
+	return 1;
+}
+
+#endif
@@ -0,0 +1,508 @@
+/*
+ * Parameterized dumbbell for PI evaluation: any number of TCP and UDP
+ * sources behind gateway0, one sink behind gateway1 and the PI queue on
+ * the bottleneck between the gateways. first-bulksend, second-bulksend
+ * and third-mix are particular cases of it.
+ *
+ * Sources come in groups, each with its own count, traffic type, access
+ * link rate and delay:
+ *   ./ns3 run "pi-dumbbell --tcpSources=50"
+ *   ./ns3 run "pi-dumbbell --tcpSources=1000 --tcpMix=TcpCubic:3,TcpNewReno:1 --udpSources=2"
+ *   ./ns3 run "pi-dumbbell --groups='5 TcpNewReno 10Mbps 5ms;2 udp 10Mbps 5ms 10Mbps'"
+ * or from a file with one group per line (--groupsFile). Any option can
+ * also be given in a file with one "name value" per line (--config); the
+ * command line overrides it.
+ *
+ * The setup time and the memory of the process are printed before the
+ * simulation starts; --setupOnly=1 stops there, to track how the setup
+ * scales with the number of sources. For large numbers of sources,
+ * --sharedAccess=N puts N sources on one CSMA segment to gateway0 and
+ * --routing=static or nix avoids building global routing tables; the
+ * path to the sink is the same either way.
+*/
+
+/* Network topology
+ *
+ *         accessBandwidth, accessDelay    bottleneckBandwidth, bottleneckDelay    accessBandwidth, accessDelay
+ *   (TCP and UDP sources)-------------(gateway0)------------------(gateway1)-------------(sink)
+ *   groups of sources,                       QueueLimit = queueLimit
+ *   each with its own link
+ *
+*/
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/csma-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/nix-vector-routing-module.h"
+#include "ns3/traffic-control-module.h"
+#include "pi-dumbbell.h"
+#include "pi-flow-stats.h"
+#include "pi-options.h"
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+using namespace std;
+
+NS_LOG_COMPONENT_DEFINE ("PiDumbbell");
+
+// Файл для записи результатов
+stringstream filePlotQueue;
+// Выборки очереди копятся в памяти и пишутся на диск блоками в отдельном потоке
+PiTraceWriter queueTrace;
+// Период опроса очереди
+Time queueSamplePeriod;
+// Переменная для подсчета количества вызовов CheckQueueSize
+uint32_t checkTimes = 0;
+// Переменная для хранения суммарного значения всей длины очереди
+double avgQueueDiscSize = 0;
+
+// Метод для вывода размера очереди и среднего значентия очереди в отдельный файл
+void CheckQueueSize (Ptr<QueueDisc> queue)
+{
+	// Запись размера очереди в переменную
+	// FqPiQueueDisc считает очередь только в пакетах
+	Ptr<PiQueueDisc> pi = DynamicCast<PiQueueDisc> (queue);
+	uint32_t qSize = pi ? pi->GetQueueSize () : queue->GetNPackets ();
+
+	// Изменяем глобальные переменные для нахождения среднего размера очереди
+	avgQueueDiscSize += qSize;
+	checkTimes++;
+
+	// Вызываем данный метод через заданный период
+	Simulator::Schedule (queueSamplePeriod, &CheckQueueSize, queue);
+
+	// Запись размера очереди, среднего размера очереди, вероятности сброса и количества сбросов;
+	// у FqPiQueueDisc вероятность своя в каждой корзине, поэтому пишется 0
+	double p = pi ? pi->GetDropProbability () : 0;
+	uint64_t drops = pi ? pi->GetDropCount () : queue->GetStats ().nTotalDroppedPackets;
+	queueTrace.Write (Simulator::Now ().GetSeconds (), qSize, avgQueueDiscSize / checkTimes, p, drops);
+}
+
+// Файлы для записи изменений вероятности сброса и времени пребывания в очереди
+ofstream fTraceProb;
+ofstream fTraceDelay;
+
+// Вызывается при каждом изменении вероятности сброса в PI
+void ProbabilityTrace (double oldValue, double newValue)
+{
+	fTraceProb << Simulator::Now ().GetSeconds () << " " << newValue << "\n";
+}
+
+// Вызывается, когда у пакета, покинувшего очередь PI, время пребывания отличается от предыдущего
+void QueueDelayTrace (Time oldValue, Time newValue)
+{
+	fTraceDelay << Simulator::Now ().GetSeconds () << " " << newValue.GetSeconds () << "\n";
+}
+
+int main (int argc, char *argv[])
+{
+	auto setupStart = chrono::steady_clock::now ();
+
+	// Вывод статистики
+	bool printPiStats = true;
+	// Время начала симуляции
+	float startTime = 0.0;		// в секундах
+	// Длительность симуляции
+	float simDuration = 101;	// в секундах
+	// Время окончания симуляции
+	float stopTime = startTime + simDuration;		// в секундах
+	// Интервал, на который равномерно разносятся запуски источников
+	float startSpread = 0;		// в секундах
+	// Только построить топологию и вывести время и память на это
+	bool setupOnly = false;
+	// Каталог для записи выводимых файлов
+	string pathOut = ".";
+	// Файл с параметрами вида "имя значение"
+	string configFile;
+	// Запись данных очереди в файл
+	bool writeForPlot = true;
+	// Период опроса очереди для записи
+	string sampleInterval = "100ms";
+	// Запись выборок очереди в двоичном виде (.pitrace), в .plotme переводит tools/pi-trace-convert
+	bool binaryTrace = false;
+	// Запись каждого изменения вероятности сброса и задержки в очереди
+	bool writeTraces = false;
+	// Статистика по потокам из FlowMonitor: скорость, задержка, потери, индекс Джайна
+	bool writeFlowMonitor = false;
+	// Наблюдать каждый flowSample-й источник
+	uint32_t flowSample = 1;
+	// Алгоритм на узком месте: ns3::PiQueueDisc или ns3::FqPiQueueDisc
+	string queueDiscType = "ns3::PiQueueDisc";
+
+	// Источники, если группы не заданы явно
+	uint32_t tcpSources = 5;
+	uint32_t udpSources = 0;
+	// Варианты TCP с весами
+	string tcpMix = "TcpNewReno";
+	// Скорость каждого источника UDP
+	string udpRate = "10Mbps";
+	// Группы источников: "количество тип скорость задержка [скорость UDP]" через ;
+	string groupsText;
+	// Файл с группами источников, по одной в строке
+	string groupsFile;
+	// Сколько источников делят один сегмент CSMA с левым шлюзом, 0 - у каждого свой канал
+	uint32_t sharedAccess = 0;
+	// Маршрутизация: global, static или nix
+	string routing = "global";
+
+	// Параметры уязвимого места
+	string bottleneckBandwidth = "10Mbps";
+	string bottleneckDelay = "50ms";
+
+	// Параметры всей остальной сети (и канала до приёмника)
+	string accessBandwidth = "10Mbps";
+	string accessDelay = "5ms";
+
+	// Параметры алгоритма PI
+	PiOptions piOptions;
+
+	// Возможность менять параметры из консоли
+	CommandLine cmd;
+	cmd.AddValue ("config", "File with one \"name value\" option per line, overridden by the command line", configFile);
+	cmd.AddValue ("pathOut", "Path to save results", pathOut);
+	cmd.AddValue ("writeForPlot", "<0/1> to write results for plot (gnuplot)", writeForPlot);
+	cmd.AddValue ("sampleInterval", "Queue sampling period for --writeForPlot, e.g. 1ms", sampleInterval);
+	cmd.AddValue ("binaryTrace", "<0/1> to write queue samples as a binary .pitrace file instead of .plotme text", binaryTrace);
+	cmd.AddValue ("writeTraces", "<0/1> to write every change of PI drop probability and queue delay (ns3::PiQueueDisc only)", writeTraces);
+	cmd.AddValue ("writeFlowMonitor", "<0/1> to write per-flow goodput, delay, RTT and loss and Jain's fairness index at the end of the run", writeFlowMonitor);
+	cmd.AddValue ("flowSample", "With --writeFlowMonitor, monitor every flowSample-th source only", flowSample);
+	cmd.AddValue ("queueDiscType", "Bottleneck queue disc: ns3::PiQueueDisc or ns3::FqPiQueueDisc", queueDiscType);
+	cmd.AddValue ("simDuration", "Simulation time in seconds", simDuration);
+	cmd.AddValue ("startSpread", "Seconds over which the source start times are spread evenly", startSpread);
+	cmd.AddValue ("setupOnly", "<0/1> to build the topology, report its setup time and memory and exit", setupOnly);
+	cmd.AddValue ("tcpSources", "Number of TCP sources, unless --groups or --groupsFile is given", tcpSources);
+	cmd.AddValue ("udpSources", "Number of UDP sources, unless --groups or --groupsFile is given", udpSources);
+	cmd.AddValue ("tcpMix", "TCP variants of the TCP sources with weights, e.g. TcpCubic:3,TcpNewReno:1", tcpMix);
+	cmd.AddValue ("udpRate", "Data rate of each UDP source", udpRate);
+	cmd.AddValue ("groups", "Source groups \"count type bandwidth delay [udpRate]\" separated by ';', type is a TCP variant or udp", groupsText);
+	cmd.AddValue ("groupsFile", "File with one source group per line, as in --groups", groupsFile);
+	cmd.AddValue ("sharedAccess", "Number of sources sharing one CSMA segment to gateway0 (at most 253); 0 gives each source its own link", sharedAccess);
+	cmd.AddValue ("routing", "Routing: global (Ipv4GlobalRoutingHelper), static (default routes) or nix (Nix-vector)", routing);
+	cmd.AddValue ("bottleneckBandwidth", "Bottleneck link data rate", bottleneckBandwidth);
+	cmd.AddValue ("bottleneckDelay", "Bottleneck link delay", bottleneckDelay);
+	cmd.AddValue ("accessBandwidth", "Access link data rate of the sources and the sink", accessBandwidth);
+	cmd.AddValue ("accessDelay", "Access link delay of the sources and the sink", accessDelay);
+	piOptions.Register (cmd);
+
+	// Параметры из файла ставятся перед параметрами командной строки,
+	// поэтому командная строка их переопределяет
+	cmd.Parse (ArgsWithConfig (argc, argv));
+	queueSamplePeriod = Time (sampleInterval);
+	stopTime = startTime + simDuration;
+
+	// Группы источников: явные или из tcpSources, tcpMix и udpSources
+	vector<SourceGroup> groups = BuildGroups (groupsText, groupsFile, tcpSources, tcpMix, udpSources, udpRate,
+	                                          accessBandwidth, accessDelay);
+
+	// Проверка вариантов TCP и подсчёт источников
+	uint32_t nSources = 0;
+	uint32_t nTcp = 0;
+	double rttSum = 0;
+	vector<TypeId> tcpTypes (groups.size ());
+	for (size_t g = 0; g < groups.size (); g++) {
+		nSources += groups[g].count;
+		rttSum += groups[g].count * 2 * (Time (groups[g].delay).GetSeconds () + Time (bottleneckDelay).GetSeconds () + Time (accessDelay).GetSeconds ());
+		if (groups[g].type != "udp") {
+			nTcp += groups[g].count;
+			NS_ABORT_MSG_IF (!TypeId::LookupByNameFailSafe ("ns3::" + groups[g].type, &tcpTypes[g]),
+			                 "Unknown TCP variant " << groups[g].type);
+		}
+	}
+	NS_ABORT_MSG_IF (nSources == 0, "No sources");
+	// Каждому источнику своя сеть /24 из 10.0.0.0/8, ещё две - шлюзам и приёмнику
+	NS_ABORT_MSG_IF (nSources > 65534, "At most 65534 sources fit in 10.0.0.0/8");
+	NS_ABORT_MSG_IF (sharedAccess > 253, "At most 253 sources fit in a shared /24 segment");
+	NS_ABORT_MSG_IF (routing != "global" && routing != "static" && routing != "nix", "Unknown routing " << routing);
+
+	LogComponentEnable ("PiQueueDisc", LOG_LEVEL_INFO);
+
+	// Узлы источников
+	NodeContainer source;
+	source.Create (nSources);
+
+	// 2 связующих шлюза
+	NodeContainer gateway;
+	gateway.Create (2);
+
+	// 1 приёмник
+	NodeContainer sink;
+	sink.Create (1);
+
+	Config::SetDefault ("ns3::DropTailQueue<Packet>::MaxSize", StringValue ("13p"));
+	Config::SetDefault ("ns3::PfifoFastQueueDisc::MaxSize", QueueSizeValue (QueueSize ("50p")));
+
+	// Значение времени ожидания для отложенных подтверждений TCP (в секундах)
+	Config::SetDefault ("ns3::TcpSocket::DelAckTimeout", TimeValue(Seconds (0)));
+	// Выключение алгоритма ограничения передачи
+	Config::SetDefault ("ns3::TcpSocketBase::LimitedTransmit", BooleanValue (false));
+	// Максимальный размер сегмента TCP в байтах (может быть скорректирован в зависимости от оббнаружения MTU)
+	Config::SetDefault ("ns3::TcpSocket::SegmentSize", UintegerValue (piOptions.meanPktSize));
+	// Включение возможности TCP window scale (параметр для увеличения размера окна приема)
+	Config::SetDefault ("ns3::TcpSocketBase::WindowScaling", BooleanValue (true));
+	// Поддержка ECN на стороне TCP
+	Config::SetDefault ("ns3::TcpSocketBase::UseEcn", StringValue (piOptions.useEcn ? "On" : "Off"));
+
+	// Настройка параметров PI алгоритма; файл гистограмм - для --writeHistogram
+	stringstream fileHist;
+	fileHist << pathOut << "/" << "pi-hist-dumbbell.txt";
+	// Время распространения туда и обратно для автонастройки A и B
+	piOptions.Apply (rttSum / nSources, fileHist.str ());
+
+	NS_LOG_INFO ("Install internet stack on all nodes.");
+	// Даёт возможность узлам использовать протоколы ip/tcp/udp
+	InternetStackHelper internet;
+	// Nix-vector строит путь при первом пакете к адресату, без таблиц на всех узлах
+	Ipv4NixVectorHelper nixRouting;
+	if (routing == "nix") {
+		internet.SetRoutingHelper (nixRouting);
+	}
+	internet.InstallAll ();
+
+	// Настройка pfifo(алгоритм обслуживания очередей работа с пакетами)
+	// С помощью TrafficControlHelper и устанавливаются все QueueDisc протоколы
+	TrafficControlHelper tchPfifo;
+	// Установка основного алгоритма
+	uint16_t handle = tchPfifo.SetRootQueueDisc ("ns3::PfifoFastQueueDisc");
+	// Настраиваем DropTail как алгоритм обработки очереди
+	tchPfifo.AddInternalQueues (handle, 3, "ns3::DropTailQueue", "MaxSize", StringValue ("1000p"));
+
+	// Настройка PI алгоритма на одельный TrafficControlHelper
+	TrafficControlHelper tchPi;
+	tchPi.SetRootQueueDisc (queueDiscType);
+
+	// Настраиваем узкое место сети, которое устанавливаем между двумя шлюзами
+	PointToPointHelper bottleneckLink;
+	bottleneckLink.SetQueue ("ns3::DropTailQueue");
+	bottleneckLink.SetDeviceAttribute ("DataRate", StringValue (bottleneckBandwidth));
+	bottleneckLink.SetChannelAttribute ("Delay", StringValue (bottleneckDelay));
+
+	NetDeviceContainer devices_gateway;
+	devices_gateway = bottleneckLink.Install (gateway.Get (0), gateway.Get (1));
+	// Только здесь используется PI алгоритма
+	QueueDiscContainer queueDiscs = tchPi.Install (devices_gateway);
+	// Фиксируем потоки случайных чисел PI: при одном и том же --RngRun
+	// результат повторяется, при разных запуски независимы
+	int64_t stream = 0;
+	for (uint32_t i = 0; i < queueDiscs.GetN (); i++) {
+		Ptr<PiQueueDisc> piDisc = DynamicCast<PiQueueDisc> (queueDiscs.Get (i));
+		Ptr<FqPiQueueDisc> fqPiDisc = DynamicCast<FqPiQueueDisc> (queueDiscs.Get (i));
+		if (piDisc) {
+			stream += piDisc->AssignStreams (stream);
+		} else if (fqPiDisc) {
+			stream += fqPiDisc->AssignStreams (stream);
+		}
+	}
+
+	// Правый шлюз соединяем с приёмником
+	PointToPointHelper accessLink;
+	accessLink.SetQueue ("ns3::DropTailQueue");
+	accessLink.SetDeviceAttribute ("DataRate", StringValue (accessBandwidth));
+	accessLink.SetChannelAttribute ("Delay", StringValue (accessDelay));
+
+	NetDeviceContainer devices_sink;
+	devices_sink = accessLink.Install (gateway.Get (1), sink.Get (0));
+	tchPfifo.Install (devices_sink);
+
+	NS_LOG_INFO ("Assign IP Addresses");
+	// Указываем адрес всей сети (с маской)
+	Ipv4AddressHelper address;
+	address.SetBase ("10.0.0.0", "255.255.255.0");
+
+	// Выдаём адрес для соединения шлюз-шлюз
+	Ipv4InterfaceContainer interfaces_gateway = address.Assign (devices_gateway);
+
+	// Выдаём адрес для соединения шлюз-приёмник
+	address.NewNetwork ();
+	Ipv4InterfaceContainer interfaces_sink = address.Assign (devices_sink);
+
+	// Приёмники TCP и UDP
+	uint16_t port = 50000;
+	uint16_t port1 = 50001;
+	Address sinkLocalAddress (InetSocketAddress (Ipv4Address::GetAny (), port));
+	Address sinkLocalAddress1 (InetSocketAddress (Ipv4Address::GetAny (), port1));
+	PacketSinkHelper sinkHelper ("ns3::TcpSocketFactory", sinkLocalAddress);
+	PacketSinkHelper sinkHelper1 ("ns3::UdpSocketFactory", sinkLocalAddress1);
+	ApplicationContainer sinkApp = sinkHelper.Install (sink);
+	sinkApp.Add (sinkHelper1.Install (sink));
+	sinkApp.Start (Seconds (startTime));
+	sinkApp.Stop (Seconds (stopTime));
+
+	// Адрес приёмника
+	AddressValue remoteAddress (InetSocketAddress (interfaces_sink.GetAddress (1), port));
+	AddressValue remoteAddress1 (InetSocketAddress (interfaces_sink.GetAddress (1), port1));
+
+	// Настраиваем вспомогающие приложения для генерации трафика
+	BulkSendHelper ftp ("ns3::TcpSocketFactory", Address ());
+	ftp.SetAttribute ("Remote", remoteAddress);
+	ftp.SetAttribute ("SendSize", UintegerValue (piOptions.meanPktSize));
+
+	OnOffHelper udpHelper ("ns3::UdpSocketFactory", Address ());
+	udpHelper.SetAttribute ("OnTime", StringValue ("ns3::ConstantRandomVariable[Constant=1]"));
+	udpHelper.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0]"));
+	udpHelper.SetAttribute ("PacketSize", UintegerValue (piOptions.meanPktSize));
+	udpHelper.SetAttribute ("Remote", remoteAddress1);
+
+	// Сегменты CSMA для общего доступа; скорость сегмента - сумма скоростей
+	// его источников, так что узким местом он не становится
+	CsmaHelper csma;
+	csma.SetQueue ("ns3::DropTailQueue");
+
+	// Маршруты по умолчанию для --routing=static: путь к приёмнику и обратно
+	// единственный, поэтому каждому узлу хватает одной записи
+	Ipv4StaticRoutingHelper staticRouting;
+	if (routing == "static") {
+		Ptr<Ipv4> ipv4 = gateway.Get (0)->GetObject<Ipv4> ();
+		staticRouting.GetStaticRouting (ipv4)->SetDefaultRoute (interfaces_gateway.GetAddress (1), ipv4->GetInterfaceForDevice (devices_gateway.Get (0)));
+		ipv4 = gateway.Get (1)->GetObject<Ipv4> ();
+		staticRouting.GetStaticRouting (ipv4)->SetDefaultRoute (interfaces_gateway.GetAddress (0), ipv4->GetInterfaceForDevice (devices_gateway.Get (1)));
+		ipv4 = sink.Get (0)->GetObject<Ipv4> ();
+		staticRouting.GetStaticRouting (ipv4)->SetDefaultRoute (interfaces_sink.GetAddress (0), ipv4->GetInterfaceForDevice (devices_sink.Get (1)));
+	}
+
+	// Источники группа за группой: канал или общий сегмент до левого шлюза,
+	// своя сеть и приложение. Контейнеры не хранятся, так что память растёт
+	// только на сами узлы и устройства
+	uint32_t index = 0;
+	for (size_t g = 0; g < groups.size (); g++) {
+		const SourceGroup &group = groups[g];
+		accessLink.SetDeviceAttribute ("DataRate", StringValue (group.bandwidth));
+		accessLink.SetChannelAttribute ("Delay", StringValue (group.delay));
+		csma.SetChannelAttribute ("Delay", StringValue (group.delay));
+		udpHelper.SetAttribute ("DataRate", DataRateValue (DataRate (group.udpRate)));
+
+		for (uint32_t k = 0; k < group.count; ) {
+			uint32_t n = sharedAccess ? min (sharedAccess, group.count - k) : 1;
+			NodeContainer members;
+			for (uint32_t j = 0; j < n; j++) {
+				members.Add (source.Get (index + j));
+			}
+
+			NetDeviceContainer devices;
+			if (sharedAccess) {
+				NodeContainer segment (gateway.Get (0));
+				segment.Add (members);
+				csma.SetChannelAttribute ("DataRate", DataRateValue (DataRate (DataRate (group.bandwidth).GetBitRate () * n)));
+				devices = csma.Install (segment);
+			} else {
+				devices = accessLink.Install (members.Get (0), gateway.Get (0));
+			}
+			tchPfifo.Install (devices);
+			address.NewNetwork ();
+			Ipv4InterfaceContainer interfaces = address.Assign (devices);
+			// Адрес левого шлюза в этой сети: в сегменте он первый, в канале - второй
+			Ipv4Address gatewayAddress = interfaces.GetAddress (sharedAccess ? 0 : 1);
+
+			for (uint32_t j = 0; j < n; j++, k++, index++) {
+				Ptr<Node> node = members.Get (j);
+				if (routing == "static") {
+					staticRouting.GetStaticRouting (node->GetObject<Ipv4> ())->SetDefaultRoute (gatewayAddress, 1);
+				}
+
+				ApplicationContainer sourceApp;
+				if (group.type == "udp") {
+					sourceApp = udpHelper.Install (node);
+				} else {
+					// Вариант TCP задаётся каждому узлу отдельно
+					node->GetObject<TcpL4Protocol> ()->SetAttribute ("SocketType", TypeIdValue (tcpTypes[g]));
+					sourceApp = ftp.Install (node);
+				}
+				sourceApp.Start (Seconds (startTime + startSpread * index / nSources));
+				sourceApp.Stop (Seconds (stopTime - 1));
+			}
+		}
+	}
+
+	// Глобальная маршрутизация строит таблицы всех узлов до всех сетей:
+	// время и память растут быстрее, чем количество источников
+	if (routing == "global") {
+		NS_LOG_INFO ("Initialize Global Routing.");
+		// Создаёт базу данных маршрутизации и инициализирует таблицы маршрутизации узлов в моделировании
+		Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+	}
+
+	// Время и память на построение топологии. Nix-vector ищет пути уже во
+	// время моделирования, при первом пакете каждого источника
+	double setupSeconds = chrono::duration<double> (chrono::steady_clock::now () - setupStart).count ();
+	uint64_t rssKb, peakKb;
+	GetMemory (rssKb, peakKb);
+	cout << "Setup: " << nSources << " sources (" << nTcp << " TCP, " << nSources - nTcp << " UDP) in "
+	     << groups.size () << " groups, " << (sharedAccess ? "shared" : "own") << " access links, " << routing
+	     << " routing: " << setupSeconds << " s, RSS " << rssKb / 1024.0 << " MB, peak "
+	     << peakKb / 1024.0 << " MB" << endl;
+	if (setupOnly) {
+		cout << "PI-SUMMARY sources=" << nSources << " setupSeconds=" << setupSeconds << " rssKb=" << rssKb
+		     << " peakRssKb=" << peakKb << endl;
+		Simulator::Destroy ();
+		return 0;
+	}
+
+	// Запись в файл данных очереди
+	if (writeForPlot) {
+		filePlotQueue << pathOut << "/" << "pi-queue-dumbbell" << (binaryTrace ? ".pitrace" : ".plotme");
+		bool opened = queueTrace.Open (filePlotQueue.str (), binaryTrace ? PiTraceWriter::BINARY : PiTraceWriter::TEXT);
+		NS_ABORT_MSG_IF (!opened, "Cannot open " << filePlotQueue.str ());
+		Ptr<QueueDisc> queue = queueDiscs.Get (0);
+		Simulator::ScheduleNow (&CheckQueueSize, queue);
+	}
+
+	// Запись изменений по трассам PI, без периодического опроса
+	if (writeTraces) {
+		stringstream fileProb, fileDelay;
+		fileProb << pathOut << "/" << "pi-prob-dumbbell.plotme";
+		fileDelay << pathOut << "/" << "pi-delay-dumbbell.plotme";
+		fTraceProb.open (fileProb.str ().c_str (), ios::out | ios::trunc);
+		fTraceDelay.open (fileDelay.str ().c_str (), ios::out | ios::trunc);
+		// Трасс Probability и QueueDelay нет у FQ-PI: у него вероятность своя у каждой корзины
+		bool connected = queueDiscs.Get (0)->TraceConnectWithoutContext ("Probability", MakeCallback (&ProbabilityTrace))
+		                 && queueDiscs.Get (0)->TraceConnectWithoutContext ("QueueDelay", MakeCallback (&QueueDelayTrace));
+		NS_ABORT_MSG_IF (!connected, "--writeTraces needs the Probability and QueueDelay traces of ns3::PiQueueDisc, not " << queueDiscType);
+	}
+
+	// Мониторы потоков ставятся после выдачи адресов
+	PiFlowStats flowStats;
+	if (writeFlowMonitor) {
+		flowStats.Install (source, sink, flowSample);
+	}
+
+	// Запуск симуляции
+	auto runStart = chrono::steady_clock::now ();
+	Simulator::Stop (Seconds (stopTime));
+	Simulator::Run ();
+	double runSeconds = chrono::duration<double> (chrono::steady_clock::now () - runStart).count ();
+	// Дописываем оставшиеся в буфере выборки очереди
+	queueTrace.Close ();
+	GetMemory (rssKb, peakKb);
+
+	// Вывод информации о выкинутых пакетах
+	if (printPiStats) {
+		piOptions.PrintStats (cout, queueDiscs.Get (0));
+	}
+
+	// Итоги по потокам дописываются в строку PI-SUMMARY
+	stringstream flowSummary;
+	if (writeFlowMonitor) {
+		stringstream fileFlows;
+		fileFlows << pathOut << "/" << "pi-flows-dumbbell.txt";
+		bool written = flowStats.Write (fileFlows.str (), flowSummary);
+		NS_ABORT_MSG_IF (!written, "Cannot write " << fileFlows.str ());
+	}
+
+	// Итоговая строка в виде ключ=значение, её собирает pi-sweep
+	cout << "PI-SUMMARY sources=" << nSources;
+	if (checkTimes > 0) {
+		cout << " meanQueue=" << avgQueueDiscSize / checkTimes;
+	}
+	piOptions.WriteSummary (cout, queueDiscs.Get (0));
+	cout << " enqueues=" << queueDiscs.Get (0)->GetStats ().nTotalReceivedPackets << " events=" << Simulator::GetEventCount ()
+	     << " setupSeconds=" << setupSeconds << " runSeconds=" << runSeconds << " peakRssKb=" << peakKb << flowSummary.str () << endl;
+
+	Simulator::Destroy ();
+	return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * Helpers shared by pi-dumbbell.cc and pi-dumbbell-mpi.cc: source groups,
+ * option files and memory of the process.
+*/
+
+#ifndef PI_DUMBBELL_H
+#define PI_DUMBBELL_H
+
+#include "ns3/core-module.h"
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+// Группа одинаковых источников
+struct SourceGroup
+{
+	uint32_t count;                 // количество источников
+	std::string type;               // вариант TCP (TcpNewReno, TcpCubic, ...) или udp
+	std::string bandwidth;          // скорость канала доступа
+	std::string delay;              // задержка канала доступа
+	std::string udpRate;            // скорость источника UDP
+};
+
+// Разбор описания группы "количество тип скорость задержка [скорость UDP]"
+inline bool ParseGroup (const std::string &text, const std::string &udpRate, SourceGroup &group)
+{
+	std::stringstream fields (text);
+	group.udpRate = udpRate;
+	if (!(fields >> group.count >> group.type >> group.bandwidth >> group.delay)) {
+		return false;
+	}
+	fields >> group.udpRate;
+	return true;
+}
+
+// Разбор групп, разделённых символом separator; строки после # пропускаются
+inline bool ParseGroups (const std::string &text, char separator, const std::string &udpRate, std::vector<SourceGroup> &groups)
+{
+	std::stringstream lines (text);
+	std::string line;
+	while (getline (lines, line, separator)) {
+		line = line.substr (0, line.find ('#'));
+		if (line.find_first_not_of (" \t\r") == std::string::npos) {
+			continue;
+		}
+		SourceGroup group;
+		if (!ParseGroup (line, udpRate, group)) {
+			return false;
+		}
+		groups.push_back (group);
+	}
+	return true;
+}
+
+// Разбиение count источников TCP по вариантам из строки вида "TcpCubic:3,TcpNewReno:1".
+// Количество каждого варианта пропорционально весу, в сумме ровно count
+inline bool ParseMix (const std::string &mix, uint32_t count, const std::string &bandwidth, const std::string &delay,
+                      std::vector<SourceGroup> &groups)
+{
+	std::vector<std::pair<std::string, double> > weights;
+	double total = 0;
+	std::stringstream items (mix);
+	std::string item;
+	while (getline (items, item, ',')) {
+		size_t colon = item.find (':');
+		double weight = (colon == std::string::npos) ? 1 : atof (item.c_str () + colon + 1);
+		if (item.empty () || weight <= 0) {
+			return false;
+		}
+		weights.push_back (std::make_pair (item.substr (0, colon), weight));
+		total += weight;
+	}
+	if (weights.empty ()) {
+		return false;
+	}
+
+	double cumulative = 0;
+	uint32_t assigned = 0;
+	for (const std::pair<std::string, double> &w : weights) {
+		cumulative += w.second;
+		uint32_t upTo = (uint32_t) llround (count * cumulative / total);
+		SourceGroup group = {upTo - assigned, w.first, bandwidth, delay, ""};
+		if (group.count > 0) {
+			groups.push_back (group);
+		}
+		assigned = upTo;
+	}
+	return true;
+}
+
+// Группы источников: из --groups и --groupsFile, а если их нет - tcpSources
+// источников TCP по вариантам tcpMix и udpSources источников UDP
+inline std::vector<SourceGroup> BuildGroups (const std::string &groupsText, const std::string &groupsFile, uint32_t tcpSources,
+                                             const std::string &tcpMix, uint32_t udpSources, const std::string &udpRate,
+                                             const std::string &accessBandwidth, const std::string &accessDelay)
+{
+	std::vector<SourceGroup> groups;
+	bool ok = ParseGroups (groupsText, ';', udpRate, groups);
+	if (ok && !groupsFile.empty ()) {
+		std::ifstream in (groupsFile);
+		NS_ABORT_MSG_IF (!in, "Cannot open " << groupsFile);
+		std::stringstream text;
+		text << in.rdbuf ();
+		ok = ParseGroups (text.str (), '\n', udpRate, groups);
+	}
+	if (ok && groups.empty ()) {
+		ok = ParseMix (tcpMix, tcpSources, accessBandwidth, accessDelay, groups);
+		if (udpSources > 0) {
+			SourceGroup udp = {udpSources, "udp", accessBandwidth, accessDelay, udpRate};
+			groups.push_back (udp);
+		}
+	}
+	NS_ABORT_MSG_IF (!ok, "Cannot parse the source groups");
+	return groups;
+}
+
+// Аргументы командной строки, перед которыми вставлены параметры из файла
+// --config (по одному "имя значение" или "имя=значение" в строке), так что
+// командная строка их переопределяет
+inline std::vector<std::string> ArgsWithConfig (int argc, char *argv[])
+{
+	std::vector<std::string> args (argv, argv + argc);
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare (0, 9, "--config=") != 0) {
+			continue;
+		}
+		std::ifstream in (arg.substr (9));
+		NS_ABORT_MSG_IF (!in, "Cannot open " << arg.substr (9));
+		std::vector<std::string> fromFile;
+		std::string line;
+		while (getline (in, line)) {
+			line = line.substr (0, line.find ('#'));
+			std::stringstream fields (line);
+			std::string name, value;
+			if (fields >> name) {
+				// Допускается и запись "имя=значение"
+				size_t eq = name.find ('=');
+				if (eq != std::string::npos) {
+					value = name.substr (eq + 1);
+					name = name.substr (0, eq);
+				} else {
+					getline (fields >> std::ws, value);
+				}
+				value.erase (value.find_last_not_of (" \t\r") + 1);
+				fromFile.push_back ("--" + name + "=" + value);
+			}
+		}
+		args.insert (args.begin () + 1, fromFile.begin (), fromFile.end ());
+		break;
+	}
+	return args;
+}
+
+// Текущий и наибольший размер резидентной памяти процесса в килобайтах
+inline void GetMemory (uint64_t &rssKb, uint64_t &peakKb)
+{
+	rssKb = 0;
+	peakKb = 0;
+	std::ifstream status ("/proc/self/status");
+	std::string line;
+	while (getline (status, line)) {
+		if (line.compare (0, 6, "VmRSS:") == 0) {
+			rssKb = strtoull (line.c_str () + 6, 0, 10);
+		} else if (line.compare (0, 6, "VmHWM:") == 0) {
+			peakKb = strtoull (line.c_str () + 6, 0, 10);
+		}
+	}
+	// Без /proc - только наибольший размер
+	if (peakKb == 0) {
+		struct rusage usage;
+		getrusage (RUSAGE_SELF, &usage);
+		peakKb = usage.ru_maxrss;
+		rssKb = rssKb ? rssKb : peakKb;
+	}
+}
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * This program measures the per-packet cost of PiQueueDisc
+ * enqueue/dequeue in packet and byte modes, outside of any topology.
+ *
+ * To compare two revisions of the PI model, run it once on each build:
+ *   ./ns3 run "pi-enqueue-bench --packets=1000000"
+*/
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/traffic-control-module.h"
+#include <chrono>
+#include <iomanip>
+#include <string>
+
+using namespace ns3;
+using namespace std;
+
+NS_LOG_COMPONENT_DEFINE ("PiEnqueueBench");
+
+// Элемент очереди без заголовков: для замеров нужен только размер пакета
+class BenchItem : public QueueDiscItem
+{
+public:
+	BenchItem (Ptr<Packet> p, const Address &addr)
+		: QueueDiscItem (p, addr, 0)
+	{
+	}
+
+	virtual void AddHeader (void)
+	{
+	}
+
+	virtual bool Mark (void)
+	{
+		return false;
+	}
+};
+
+// Замер одного режима: очередь держится около queueRef, затем packets раз
+// выполняется пара Enqueue/Dequeue. Возвращает наносекунды на одну пару
+double RunMode (string mode, uint32_t pktSize, uint32_t queueRef, uint32_t queueLimit, uint32_t packets)
+{
+	Ptr<PiQueueDisc> queue = CreateObjectWithAttributes<PiQueueDisc> (
+		"Mode", StringValue (mode),
+		"MeanPktSize", UintegerValue (pktSize),
+		"QueueRef", DoubleValue (queueRef),
+		"QueueLimit", DoubleValue (queueLimit));
+	queue->Initialize ();
+
+	Address dest;
+	// Пакеты создаются заранее, чтобы не учитывать стоимость их выделения
+	vector<Ptr<QueueDiscItem> > items;
+	items.reserve (queueRef + 1);
+	for (uint32_t i = 0; i <= queueRef; i++) {
+		items.push_back (Create<BenchItem> (Create<Packet> (pktSize), dest));
+	}
+
+	for (uint32_t i = 0; i < queueRef; i++) {
+		queue->Enqueue (items[i]);
+	}
+
+	// Вынутый пакет сразу ставится обратно, длина очереди не меняется
+	Ptr<QueueDiscItem> item = items[queueRef];
+	auto start = chrono::steady_clock::now ();
+	for (uint32_t i = 0; i < packets; i++) {
+		queue->Enqueue (item);
+		item = queue->Dequeue ();
+	}
+	auto stop = chrono::steady_clock::now ();
+
+	queue->Dispose ();
+	return chrono::duration<double, nano> (stop - start).count () / packets;
+}
+
+int main (int argc, char *argv[])
+{
+	// Количество пар Enqueue/Dequeue на один замер
+	uint32_t packets = 1000000;
+	// Количество повторов, берётся лучший результат
+	uint32_t repeats = 5;
+	// Размер пакета в байтах
+	uint32_t pktSize = 1000;
+	// Длина очереди, вокруг которой идут замеры (в пакетах)
+	uint32_t queueRef = 50;
+
+	CommandLine cmd;
+	cmd.AddValue ("packets", "Enqueue/dequeue pairs per measurement", packets);
+	cmd.AddValue ("repeats", "Measurements per mode, the best one is reported", repeats);
+	cmd.AddValue ("pktSize", "Packet size in bytes", pktSize);
+	cmd.AddValue ("queueRef", "Queue length held during the measurement, in packets", queueRef);
+	cmd.Parse (argc, argv);
+
+	const string modes[] = {"QUEUE_MODE_PACKETS", "QUEUE_MODE_BYTES"};
+	for (const string &mode : modes) {
+		bool bytes = mode == "QUEUE_MODE_BYTES";
+		uint32_t ref = bytes ? queueRef * pktSize : queueRef;
+		uint32_t limit = 4 * ref;
+		double best = 0;
+		for (uint32_t r = 0; r < repeats; r++) {
+			double ns = RunMode (mode, pktSize, ref, limit, packets);
+			best = (r == 0 || ns < best) ? ns : best;
+		}
+		cout << setw (20) << left << mode << fixed << setprecision (1)
+		     << best << " ns per enqueue+dequeue" << endl;
+	}
+
+	Simulator::Destroy ();
+	return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * Per-flow statistics of the traffic scripts from FlowMonitor
+ * (--writeFlowMonitor=1): goodput, one-way delay, round-trip time and loss
+ * of every flow from the sources to the sink, and Jain's fairness index
+ * over them. Goodput counts the bytes the PacketSink applications hand
+ * to the application, without headers and retransmissions; throughput
+ * counts the IP bytes FlowMonitor saw at the sink.
+ *
+ * The monitor is installed on the sink and on every flowSample-th source
+ * only. Packets of the other sources carry no flow tag, so they cost the
+ * probes one tag lookup at the sink; the acknowledgements the sink sends
+ * them are still classified, but without histograms a flow takes a few
+ * hundred bytes. With 10000 sources --flowSample=100 still gives 100
+ * flows to average over.
+*/
+
+#ifndef PI_FLOW_STATS_H
+#define PI_FLOW_STATS_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/flow-monitor-module.h"
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+
+class PiFlowStats
+{
+public:
+	// Мониторы на приёмники и на каждый sample-й источник; вызывается после
+	// выдачи адресов и установки PacketSink, адреса источников отличают прямые
+	// потоки от обратных
+	void Install (ns3::NodeContainer sources, ns3::NodeContainer sinks, uint32_t sample)
+	{
+		using namespace ns3;
+		// Гистограммы не выводятся, поэтому одна корзина на поток вместо сотен
+		m_helper.SetMonitorAttribute ("DelayBinWidth", DoubleValue (1000));
+		m_helper.SetMonitorAttribute ("JitterBinWidth", DoubleValue (1000));
+		m_helper.SetMonitorAttribute ("PacketSizeBinWidth", DoubleValue (100000));
+
+		NodeContainer nodes (sinks);
+		sample = sample ? sample : 1;
+		for (uint32_t i = 0; i < sources.GetN (); i += sample) {
+			Ptr<Ipv4> ipv4 = sources.Get (i)->GetObject<Ipv4> ();
+			for (uint32_t j = 1; j < ipv4->GetNInterfaces (); j++) {
+				m_sourceAddresses.insert (ipv4->GetAddress (j, 0).GetLocal ().Get ());
+			}
+			nodes.Add (sources.Get (i));
+		}
+		m_monitor = m_helper.Install (nodes);
+		m_sample = sample;
+
+		// Полезные байты потока считает PacketSink на приёмнике
+		for (uint32_t i = 0; i < sinks.GetN (); i++) {
+			Ptr<Node> node = sinks.Get (i);
+			for (uint32_t k = 0; k < node->GetNApplications (); k++) {
+				Ptr<PacketSink> app = DynamicCast<PacketSink> (node->GetApplication (k));
+				if (app) {
+					app->TraceConnectWithoutContext ("RxWithAddresses", MakeCallback (&PiFlowStats::Received, this));
+				}
+			}
+		}
+	}
+
+	// Строка на каждый прямой поток в fileName и итоги в виде ключ=значение в summary
+	bool Write (const std::string &fileName, std::ostream &summary)
+	{
+		using namespace ns3;
+		m_monitor->CheckForLostPackets ();
+		Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier> (m_helper.GetClassifier ());
+		const FlowMonitor::FlowStatsContainer &stats = m_monitor->GetFlowStats ();
+
+		// Обратный поток (подтверждения TCP) ищется по перевёрнутой пятёрке
+		typedef std::tuple<uint32_t, uint32_t, uint16_t, uint16_t, uint8_t> Key;
+		std::map<Key, FlowId> flowOf;
+		for (const auto &f : stats) {
+			Ipv4FlowClassifier::FiveTuple t = classifier->FindFlow (f.first);
+			flowOf[Key (t.sourceAddress.Get (), t.destinationAddress.Get (), t.sourcePort, t.destinationPort, t.protocol)] = f.first;
+		}
+
+		std::ofstream out (fileName.c_str (), std::ios::out | std::ios::trunc);
+		out << "# flow source destination protocol txPackets rxPackets lostPackets goodputBps throughputBps delay rtt loss\n";
+		// Суммы для индекса Джайна: все потоки, TCP и UDP
+		double sum[3] = {0, 0, 0};
+		double sumSq[3] = {0, 0, 0};
+		uint32_t n[3] = {0, 0, 0};
+		double delaySum = 0;
+		double rttSum = 0;
+		uint32_t rttFlows = 0;
+		uint64_t txPackets = 0;
+		uint64_t lostPackets = 0;
+		char line[256];
+		for (const auto &f : stats) {
+			Ipv4FlowClassifier::FiveTuple t = classifier->FindFlow (f.first);
+			if (m_sourceAddresses.count (t.sourceAddress.Get ()) == 0) {
+				continue;
+			}
+			const FlowMonitor::FlowStats &s = f.second;
+			// Полезные байты и байты IP, доставленные приёмнику, за время жизни потока
+			double duration = (s.timeLastRxPacket - s.timeFirstTxPacket).GetSeconds ();
+			auto app = m_appBytes.find (Endpoint (t.sourceAddress.Get (), t.sourcePort));
+			uint64_t appBytes = (app != m_appBytes.end ()) ? app->second : 0;
+			double goodput = (s.rxPackets > 0 && duration > 0) ? appBytes * 8.0 / duration : 0;
+			double throughput = (s.rxPackets > 0 && duration > 0) ? s.rxBytes * 8.0 / duration : 0;
+			double delay = s.rxPackets > 0 ? s.delaySum.GetSeconds () / s.rxPackets : 0;
+			double loss = s.txPackets > 0 ? (double) s.lostPackets / s.txPackets : 0;
+			// Время туда и обратно - задержка пакетов плюс задержка подтверждений
+			double rtt = 0;
+			auto back = flowOf.find (Key (t.destinationAddress.Get (), t.sourceAddress.Get (), t.destinationPort, t.sourcePort, t.protocol));
+			if (back != flowOf.end ()) {
+				const FlowMonitor::FlowStats &b = stats.at (back->second);
+				if (s.rxPackets > 0 && b.rxPackets > 0) {
+					rtt = delay + b.delaySum.GetSeconds () / b.rxPackets;
+					rttSum += rtt;
+					rttFlows++;
+				}
+			}
+
+			int kind = (t.protocol == 6) ? 1 : 2;
+			for (int k : {0, kind}) {
+				sum[k] += goodput;
+				sumSq[k] += goodput * goodput;
+				n[k]++;
+			}
+			delaySum += delay;
+			txPackets += s.txPackets;
+			lostPackets += s.lostPackets;
+
+			std::ostringstream source, destination;
+			source << t.sourceAddress;
+			destination << t.destinationAddress;
+			int length = std::snprintf (line, sizeof (line), "%u %s:%u %s:%u %u %llu %llu %llu %g %g %g %g %g\n", f.first,
+			                            source.str ().c_str (), t.sourcePort, destination.str ().c_str (), t.destinationPort,
+			                            t.protocol, (unsigned long long) s.txPackets, (unsigned long long) s.rxPackets,
+			                            (unsigned long long) s.lostPackets, goodput, throughput, delay, rtt, loss);
+			out.write (line, length);
+		}
+		out.close ();
+
+		summary << " flows=" << n[0] << " flowSample=" << m_sample;
+		if (n[0] > 0) {
+			summary << " jainIndex=" << Jain (sum[0], sumSq[0], n[0]) << " meanGoodputBps=" << sum[0] / n[0]
+			        << " meanFlowDelay=" << delaySum / n[0];
+		}
+		if (n[1] > 0) {
+			summary << " jainTcp=" << Jain (sum[1], sumSq[1], n[1]);
+		}
+		if (n[2] > 0) {
+			summary << " jainUdp=" << Jain (sum[2], sumSq[2], n[2]);
+		}
+		if (rttFlows > 0) {
+			summary << " meanRtt=" << rttSum / rttFlows;
+		}
+		if (txPackets > 0) {
+			summary << " flowLoss=" << (double) lostPackets / txPackets;
+		}
+		return !out.fail ();
+	}
+
+private:
+	typedef std::pair<uint32_t, uint16_t> Endpoint;
+
+	// Приём PacketSink: байты приложения по адресу и порту источника
+	void Received (ns3::Ptr<const ns3::Packet> packet, const ns3::Address &from, const ns3::Address &local)
+	{
+		using namespace ns3;
+		if (!InetSocketAddress::IsMatchingType (from)) {
+			return;
+		}
+		InetSocketAddress address = InetSocketAddress::ConvertFrom (from);
+		uint32_t source = address.GetIpv4 ().Get ();
+		if (m_sourceAddresses.count (source) != 0) {
+			m_appBytes[Endpoint (source, address.GetPort ())] += packet->GetSize ();
+		}
+	}
+
+	// Индекс Джайна (сумма x)^2 / (n сумма x^2): 1 - поровну, 1/n - всё у одного
+	static double Jain (double sum, double sumSq, uint32_t n)
+	{
+		return sumSq > 0 ? sum * sum / (n * sumSq) : 1;
+	}
+
+	ns3::FlowMonitorHelper m_helper;
+	ns3::Ptr<ns3::FlowMonitor> m_monitor;
+	std::set<uint32_t> m_sourceAddresses;        // адреса наблюдаемых источников
+	uint32_t m_sample = 1;                       // наблюдается каждый m_sample-й
+	std::map<Endpoint, uint64_t> m_appBytes;     // полезные байты наблюдаемых потоков
+};
+
+#endif
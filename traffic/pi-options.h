@@ -0,0 +1,157 @@
+/*
+ * Command line options of the PI queue shared by first-bulksend,
+ * second-bulksend, third-mix, pi-dumbbell and pi-dumbbell-mpi.
+ * Register adds the options to the CommandLine of a script, Apply turns
+ * them into Config::SetDefault for PiQueueDisc (ApplyFqPi for
+ * FqPiQueueDisc, where the attribute exists there too), and PrintStats
+ * and WriteSummary print the stats of the bottleneck queue. A new PI
+ * attribute is thus added once here instead of in every script.
+*/
+
+#ifndef PI_OPTIONS_H
+#define PI_OPTIONS_H
+
+#include "ns3/core-module.h"
+#include "ns3/traffic-control-module.h"
+#include <ostream>
+#include <string>
+
+class PiOptions
+{
+public:
+	// Средний размер одного пакета, в байтах
+	uint32_t meanPktSize = 1000;
+	// Режим работы (в пакетах или в байтах)
+	std::string mode = "QUEUE_MODE_PACKETS";
+	// Желаемый размер очереди для PI
+	uint32_t queueRef = 50;
+	// Предел очереди
+	uint32_t queueLimit = 200;
+	// Параметры A и B (по умолчанию - значения атрибутов PiQueueDisc)
+	double a = 0.00001822;
+	double b = 0.00001816;
+	// Желаемая задержка в очереди, "0s" - регулировать длину очереди
+	std::string delayRef = "0s";
+	// Маркировка ECN вместо ранних сбросов
+	bool useEcn = false;
+	// Автоматическая настройка параметров A и B
+	bool autoTune = false;
+	bool adaptiveSampling = false;
+	// Защита интегратора PI от насыщения и допуск всплесков после простоя, как в PIE
+	std::string antiWindup = "None";
+	std::string burstAllowance = "0s";
+	// Гистограммы задержки и длины очереди для перцентилей и их запись в конце моделирования
+	bool histograms = false;
+	bool writeHistogram = false;
+
+	// Параметры PI в командной строке; histogram - принимать --writeHistogram
+	void Register (ns3::CommandLine &cmd, bool histogram = true)
+	{
+		cmd.AddValue ("meanPktSize", "Packet and TCP segment size in bytes", meanPktSize);
+		cmd.AddValue ("queueRef", "Desired PI queue size", queueRef);
+		cmd.AddValue ("queueLimit", "PI queue limit", queueLimit);
+		cmd.AddValue ("A", "PI parameter A", a);
+		cmd.AddValue ("B", "PI parameter B", b);
+		cmd.AddValue ("delayRef", "Queue delay PI regulates to instead of QueueRef, e.g. 20ms; 0s disables", delayRef);
+		cmd.AddValue ("useEcn", "<0/1> to mark ECN-capable packets instead of dropping them early", useEcn);
+		cmd.AddValue ("autoTune", "<0/1> to let PI compute A and B from measured capacity, flows and RTT", autoTune);
+		cmd.AddValue ("adaptiveSampling", "<0/1> to vary the PI sampling interval with the error (fewer updates at steady state)", adaptiveSampling);
+		cmd.AddValue ("antiWindup", "PI anti-windup: None, Conditional or BackCalculation", antiWindup);
+		cmd.AddValue ("burstAllowance", "Time PI does not drop early after the queue was idle, as in PIE, e.g. 150ms; 0s disables", burstAllowance);
+		cmd.AddValue ("histograms", "<0/1> to record PI sojourn time and queue length histograms and print their percentiles", histograms);
+		if (histogram) {
+			cmd.AddValue ("writeHistogram", "<0/1> to write PI sojourn time and queue length histograms at the end of the run", writeHistogram);
+		}
+	}
+
+	// Значения по умолчанию атрибутов PI; baseRtt - время распространения
+	// туда и обратно для AutoTune, histFile - файл гистограмм для --writeHistogram
+	void Apply (double baseRtt, const std::string &histFile) const
+	{
+		using namespace ns3;
+		Config::SetDefault ("ns3::PiQueueDisc::MeanPktSize", UintegerValue (meanPktSize));
+		Config::SetDefault ("ns3::PiQueueDisc::Mode", StringValue (mode));
+		Config::SetDefault ("ns3::PiQueueDisc::QueueRef", DoubleValue (queueRef));
+		// Желаемая задержка (если задана, заменяет желаемый размер очереди)
+		Config::SetDefault ("ns3::PiQueueDisc::DelayRef", TimeValue (Time (delayRef)));
+		Config::SetDefault ("ns3::PiQueueDisc::QueueLimit", DoubleValue (queueLimit));
+		Config::SetDefault ("ns3::PiQueueDisc::A", DoubleValue (a));
+		Config::SetDefault ("ns3::PiQueueDisc::B", DoubleValue (b));
+		Config::SetDefault ("ns3::PiQueueDisc::UseEcn", BooleanValue (useEcn));
+		Config::SetDefault ("ns3::PiQueueDisc::AutoTune", BooleanValue (autoTune));
+		Config::SetDefault ("ns3::PiQueueDisc::AdaptiveSampling", BooleanValue (adaptiveSampling));
+		Config::SetDefault ("ns3::PiQueueDisc::AntiWindup", StringValue (antiWindup));
+		Config::SetDefault ("ns3::PiQueueDisc::MaxBurstAllowance", TimeValue (Time (burstAllowance)));
+		Config::SetDefault ("ns3::PiQueueDisc::BaseRtt", TimeValue (Seconds (baseRtt)));
+		// Перцентили выводятся и при --writeHistogram, так что гистограммы
+		// ведутся при любой из двух опций, даже если файла нет
+		Config::SetDefault ("ns3::PiQueueDisc::Histograms", BooleanValue (histograms || writeHistogram));
+		if (writeHistogram && !histFile.empty ()) {
+			Config::SetDefault ("ns3::PiQueueDisc::HistogramFile", StringValue (histFile));
+		}
+		ApplyFqPi ();
+	}
+
+	// Те же опции для --queueDiscType=ns3::FqPiQueueDisc: общий предел очереди,
+	// но в пакетах, и те же законы управления у контроллера каждой корзины.
+	// QueueRef, DelayRef, AutoTune, AdaptiveSampling и гистограмм у FQ-PI нет,
+	// желаемая длина у него своя, на корзину (атрибут QueueRef по умолчанию)
+	void ApplyFqPi () const
+	{
+		using namespace ns3;
+		Config::SetDefault ("ns3::FqPiQueueDisc::MaxSize", QueueSizeValue (QueueSize (QueueSizeUnit::PACKETS, queueLimit)));
+		Config::SetDefault ("ns3::FqPiQueueDisc::A", DoubleValue (a));
+		Config::SetDefault ("ns3::FqPiQueueDisc::B", DoubleValue (b));
+		Config::SetDefault ("ns3::FqPiQueueDisc::UseEcn", BooleanValue (useEcn));
+		Config::SetDefault ("ns3::FqPiQueueDisc::AntiWindup", StringValue (antiWindup));
+		Config::SetDefault ("ns3::FqPiQueueDisc::MaxBurstAllowance", TimeValue (Time (burstAllowance)));
+	}
+
+	// Сбросы, маркировки и перцентили очереди узкого места (PI или FQ-PI)
+	void PrintStats (std::ostream &os, ns3::Ptr<ns3::QueueDisc> queue) const
+	{
+		using namespace ns3;
+		Ptr<FqPiQueueDisc> fqPi = DynamicCast<FqPiQueueDisc> (queue);
+		if (fqPi) {
+			FqPiQueueDisc::Stats st = fqPi->GetStats ();
+			os << "*** fq-pi stats from bottleneck queue ***" << std::endl;
+			os << "\t " << st.unforcedDrop << " drops due to probability " << std::endl;
+			os << "\t " << st.forcedDrop << " drops due queue full" << std::endl;
+			os << "\t " << st.unforcedMark << " marks due to probability " << std::endl;
+			return;
+		}
+		PiQueueDisc::Stats st = StaticCast<PiQueueDisc> (queue)->GetStats ();
+		os << "*** pi stats from bottleneck queue ***" << std::endl;
+		os << "\t " << st.unforcedDrop << " drops due to probability " << std::endl;
+		os << "\t " << st.forcedDrop << " drops due queue full" << std::endl;
+		os << "\t " << st.unforcedMark << " marks due to probability " << std::endl;
+		if (!histograms && !writeHistogram) {
+			return;
+		}
+		os << "\t queue delay P50/P99/P99.9: " << st.delayP50.GetSeconds () << " / " << st.delayP99.GetSeconds () << " / " << st.delayP999.GetSeconds () << " s" << std::endl;
+		os << "\t queue length P50/P99/P99.9: " << st.qlenP50 << " / " << st.qlenP99 << " / " << st.qlenP999 << std::endl;
+	}
+
+	// Итоги очереди узкого места в виде ключ=значение для строки PI-SUMMARY
+	void WriteSummary (std::ostream &summary, ns3::Ptr<ns3::QueueDisc> queue) const
+	{
+		using namespace ns3;
+		Ptr<FqPiQueueDisc> fqPi = DynamicCast<FqPiQueueDisc> (queue);
+		if (fqPi) {
+			FqPiQueueDisc::Stats st = fqPi->GetStats ();
+			summary << " unforcedDrop=" << st.unforcedDrop << " forcedDrop=" << st.forcedDrop << " unforcedMark=" << st.unforcedMark;
+			return;
+		}
+		Ptr<PiQueueDisc> pi = StaticCast<PiQueueDisc> (queue);
+		PiQueueDisc::Stats st = pi->GetStats ();
+		summary << " unforcedDrop=" << st.unforcedDrop << " forcedDrop=" << st.forcedDrop << " unforcedMark=" << st.unforcedMark
+		        << " throughputBps=" << pi->GetLifetimeThroughput () * 8;
+		// Перцентили есть, только если гистограммы включены
+		if (histograms || writeHistogram) {
+			summary << " delayP50=" << st.delayP50.GetSeconds () << " delayP99=" << st.delayP99.GetSeconds () << " qlenP99=" << st.qlenP99;
+		}
+		summary << " controllerUpdates=" << st.controllerUpdates;
+	}
+};
+
+#endif
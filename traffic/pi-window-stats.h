@@ -0,0 +1,78 @@
+/*
+ * Drops and throughput of the PI queue over windows of the run, such as
+ * the startup or the seconds after a load change, to compare controller
+ * variants (AntiWindup, MaxBurstAllowance) on transients rather than on
+ * the whole run. Each window adds <name>Drops, <name>UnforcedDrops and
+ * <name>ThroughputBps to the PI-SUMMARY line.
+*/
+
+#ifndef PI_WINDOW_STATS_H
+#define PI_WINDOW_STATS_H
+
+#include "ns3/core-module.h"
+#include "ns3/traffic-control-module.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+class PiWindowStats
+{
+public:
+	// Окно [start, start + length] в секундах модельного времени; вызывается до Simulator::Run
+	void Add (ns3::Ptr<ns3::PiQueueDisc> pi, const std::string &name, double start, double length)
+	{
+		using namespace ns3;
+		Window w = {pi, name, length, 0, 0, 0, 0, 0, 0, false};
+		m_windows.push_back (w);
+		// Окно с самого начала отсчитывается от нуля: до инициализации очереди статистики ещё нет
+		if (start > 0) {
+			Simulator::Schedule (Seconds (start), &PiWindowStats::Begin, this, m_windows.size () - 1);
+		}
+		Simulator::Schedule (Seconds (start + length), &PiWindowStats::End, this, m_windows.size () - 1);
+	}
+
+	// Итоги закончившихся окон в виде ключ=значение
+	void Write (std::ostream &summary) const
+	{
+		for (const Window &w : m_windows) {
+			if (!w.done) {
+				continue;
+			}
+			summary << " " << w.name << "Drops=" << w.drops << " " << w.name << "UnforcedDrops=" << w.unforced
+			        << " " << w.name << "ThroughputBps=" << w.bytes * 8 / w.length;
+		}
+	}
+
+private:
+	struct Window
+	{
+		ns3::Ptr<ns3::PiQueueDisc> pi;
+		std::string name;
+		double length;
+		uint64_t drops0, unforced0, bytes0;       // счётчики в начале окна
+		uint64_t drops, unforced, bytes;          // приращения за окно
+		bool done;
+	};
+
+	void Begin (size_t i)
+	{
+		ns3::PiQueueDisc::Stats st = m_windows[i].pi->GetStats ();
+		m_windows[i].drops0 = st.unforcedDrop + st.forcedDrop;
+		m_windows[i].unforced0 = st.unforcedDrop;
+		m_windows[i].bytes0 = st.bytesDequeued;
+	}
+
+	void End (size_t i)
+	{
+		Window &w = m_windows[i];
+		ns3::PiQueueDisc::Stats st = w.pi->GetStats ();
+		w.drops = st.unforcedDrop + st.forcedDrop - w.drops0;
+		w.unforced = st.unforcedDrop - w.unforced0;
+		w.bytes = st.bytesDequeued - w.bytes0;
+		w.done = true;
+	}
+
+	std::vector<Window> m_windows;
+};
+
+#endif